@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <ctype.h>
+
+#include "backup.h"
+
+/*-----------------------------------------------------------------------------
+ * backup.c -- find the DFA states that make the scanner back up
+ *
+ * With maximal munch the scanner remembers the last accepting state and
+ * where it was, because the DFA might go on and jam before reaching another
+ * one. Then it has to back up: the bytes read after the last accept are
+ * scanned again as the next token.
+ *
+ * Backing up only happens when the DFA jams in a non-accepting state after
+ * taking a transition. Bytes >= MAX_CHARS never match, so every such state
+ * could jam, and a DFA is backup-free exactly when all the states it could
+ * reach by a transition accept. Then a token always ends where the DFA jams,
+ * and the scanner does not track the last accept at all(see scan.c).
+ *
+ * The scanning loop starts a token from the start state of a condition,
+ * states 0 ... nconds-1, or from its start state at the beginning of a line,
+ * accept[c].bol. Jamming there before any transition means no rule matches.
+ * min_dfa() might merge the latter with an inner state, so the states the
+ * loop could reach are found from these, not from the states no transition
+ * enters. The start states of trailing contexts are not used by the
+ * scanning loop, nor are the states reached only from them.
+ *
+ * Like flex -b, the report lists every such state, the rules it is in the
+ * middle of(the rules accepted by the states reachable from it) and the
+ * bytes it goes on with or jams on.
+ *---------------------------------------------------------------------------*/
+
+#define NBYTES 256      /* bytes listed in the report, the ones >= MAX_CHARS
+                         * always jam */
+
+static void reach(ROW *dtrans, int nstates, int from, bool *seen);
+static void print_state(ROW *dtrans, accept_t *accept, int nstates,
+                        int state, FILE *report);
+static void print_bytes(FILE *report, ROW *dtrans, int state, bool jam);
+static void print_byte(FILE *report, int c);
+
+/*----------------------------------------------------------------------------*/
+/* Find the states of the DFA that could need backing up, return the number
+ * of them. They are listed in *report* if it is not NULL. */
+int dfa_backup(ROW *dtrans, accept_t *accept, int nstates, FILE *report)
+{
+    bool *inner;    /* entered by a transition */
+    bool *scanned;  /* could be reached by the scanning loop */
+    int nconds = dfa_conds(NULL);
+    int nbackup = 0;
+    int state;
+    int c;
+
+    inner = (bool *)calloc(nstates, sizeof(bool));
+    scanned = (bool *)calloc(nstates, sizeof(bool));
+    if (inner == NULL || scanned == NULL) {
+        fprintf(stderr, "dfa_backup: not enough memory\n");
+        exit(1);
+    }
+
+    for (state = 0; state < nstates; state++) {
+        for (c = 0; c < MAX_CHARS; c++) {
+            if (dtrans[state][c] != F) {
+                inner[dtrans[state][c]] = true;
+            }
+        }
+    }
+
+    /* from the start states of the conditions */
+    for (c = 0; c < nconds && c < nstates; c++) {
+        if (!scanned[c]) {
+            reach(dtrans, nstates, c, scanned);
+        }
+        if (!scanned[accept[c].bol]) {
+            reach(dtrans, nstates, accept[c].bol, scanned);
+        }
+    }
+
+    for (state = 0; state < nstates; state++) {
+        if (scanned[state] && inner[state] && accept[state].string == NULL) {
+            nbackup++;
+            if (report != NULL) {
+                print_state(dtrans, accept, nstates, state, report);
+            }
+        }
+    }
+
+    if (report != NULL) {
+        if (nbackup == 0) {
+            fprintf(report, "No backing up.\n");
+        } else {
+            fprintf(report, "%d backing up (non-accepting) states.\n",
+                    nbackup);
+        }
+    }
+
+    free(inner);
+    free(scanned);
+    return nbackup;
+}
+
+/*----------------------------------------------------------------------------*/
+/* mark in *seen* the states reachable from *from*, including itself */
+static void reach(ROW *dtrans, int nstates, int from, bool *seen)
+{
+    int *stack;
+    int top = 0;
+    int state;
+    int c;
+
+    stack = (int *)malloc(nstates * sizeof(int));
+    if (stack == NULL) {
+        fprintf(stderr, "reach: not enough memory\n");
+        exit(1);
+    }
+
+    seen[from] = true;
+    stack[top++] = from;
+    while (top > 0) {
+        state = stack[--top];
+        for (c = 0; c < MAX_CHARS; c++) {
+            if (dtrans[state][c] != F && !seen[dtrans[state][c]]) {
+                seen[dtrans[state][c]] = true;
+                stack[top++] = dtrans[state][c];
+            }
+        }
+    }
+
+    free(stack);
+}
+
+/* State #5 is non-accepting -
+ *  associated rule line numbers:
+ *         2       3
+ *  out-transitions: [ b ]
+ *  jam-transitions: EOF [ \000-a c-\377 ]
+ */
+static void print_state(ROW *dtrans, accept_t *accept, int nstates,
+                        int state, FILE *report)
+{
+    bool *seen;
+    bool *lines;    /* line numbers of the rules */
+    int maxline = 0;
+    int i;
+
+    seen = (bool *)calloc(nstates, sizeof(bool));
+    if (seen == NULL) {
+        fprintf(stderr, "print_state: not enough memory\n");
+        exit(1);
+    }
+    reach(dtrans, nstates, state, seen);
+
+    for (i = 0; i < nstates; i++) {
+        if (seen[i] && accept[i].string != NULL &&
+            ACCEPT_LINE(accept[i].string) > maxline) {
+            maxline = ACCEPT_LINE(accept[i].string);
+        }
+        if (seen[i] && accept[i].eol != NULL &&
+            ACCEPT_LINE(accept[i].eol) > maxline) {
+            maxline = ACCEPT_LINE(accept[i].eol);
+        }
+    }
+    lines = (bool *)calloc(maxline + 1, sizeof(bool));
+    if (lines == NULL) {
+        fprintf(stderr, "print_state: not enough memory\n");
+        exit(1);
+    }
+    for (i = 0; i < nstates; i++) {
+        if (seen[i] && accept[i].string != NULL) {
+            lines[ACCEPT_LINE(accept[i].string)] = true;
+        }
+        if (seen[i] && accept[i].eol != NULL) {
+            lines[ACCEPT_LINE(accept[i].eol)] = true;
+        }
+    }
+
+    fprintf(report, "State #%d is non-accepting -\n", state);
+    fprintf(report, " associated rule line numbers:\n");
+    for (i = 0; i <= maxline; i++) {
+        if (lines[i]) {
+            fprintf(report, "\t%d", i);
+        }
+    }
+    fprintf(report, "\n out-transitions: ");
+    print_bytes(report, dtrans, state, false);
+    fprintf(report, "\n jam-transitions: EOF ");
+    print_bytes(report, dtrans, state, true);
+    fprintf(report, "\n\n");
+
+    free(seen);
+    free(lines);
+}
+
+/* print the ranges of bytes *state* goes on with, or jams on if *jam* */
+static void print_bytes(FILE *report, ROW *dtrans, int state, bool jam)
+{
+    int first;
+    int c;
+
+#define JAMS(c) ((c) >= MAX_CHARS || dtrans[state][c] == F)
+
+    fprintf(report, "[ ");
+    for (c = 0; c < NBYTES; c++) {
+        if (JAMS(c) != jam) {
+            continue;
+        }
+        first = c;
+        while (c + 1 < NBYTES && JAMS(c + 1) == jam) {
+            c++;
+        }
+        print_byte(report, first);
+        if (c > first) {
+            fprintf(report, "-");
+            print_byte(report, c);
+        }
+        fprintf(report, " ");
+    }
+    fprintf(report, "]");
+
+#undef JAMS
+}
+
+/* print a byte as itself if it is printable, in octal otherwise */
+static void print_byte(FILE *report, int c)
+{
+    if (c < MAX_CHARS && isgraph(c) && c != '\\') {
+        fprintf(report, "%c", c);
+    } else {
+        fprintf(report, "\\%03o", c);
+    }
+}
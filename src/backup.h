@@ -0,0 +1,20 @@
+#ifndef BACKUP_H
+#define BACKUP_H
+
+/*-----------------------------------------------------------------------------
+ * backup.h -- find the DFA states that make the scanner back up
+ *---------------------------------------------------------------------------*/
+#include <stdio.h>
+#include "dfa.h"
+
+/*----------------------------------------------------------------------------*/
+/* Find the states of the DFA that could need backing up: non-accepting
+ * states the scanner could jam in after a transition, so it has to go back
+ * to the end of the last accepted lexeme. Return the number of them, 0 if
+ * the DFA is backup-free. If *report* is not NULL, the states are listed in
+ * it like flex -b does, with the rules that make them. The start
+ * conditions are taken from dfa_conds(), so the tables should be the ones
+ * of the last DFA made. */
+int dfa_backup(ROW *dtrans, accept_t *accept, int nstates, FILE *report);
+
+#endif /* end of include guard: BACKUP_H */
@@ -0,0 +1,107 @@
+/* bench_accel.c
+ * Time the scanner on comment and white space heavy input, with and without
+ * the acceleration of self-looping states. Run it with `make bench`. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "dfa.h"
+#include "scan.h"
+
+char *rules[] = {
+    "\\/\\*[^*]*\\*\\/ COMMENT",
+    "[\\s\\t\\n]+",
+    "[a-z]+ ID",
+    NULL,
+};
+
+char **line = rules-1;
+
+char *get_expr(void)
+{
+    line++;
+    return *line;
+}
+
+#define SIZE (64 * 1024 * 1024)
+#define ROUNDS 5
+
+/* the best of ROUNDS scans of *buf* in seconds, *ntokens* is set to the
+ * number of tokens */
+static double scan_time(scanner_t *scanner, const char *buf, long len,
+                        long *ntokens)
+{
+    struct timespec t0, t1;
+    token_t token;
+    double best = 0;
+    double t;
+    int i;
+
+    for (i = 0; i < ROUNDS; i++) {
+        *ntokens = 0;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        zlex_scan_buffer(scanner, buf, len);
+        while (zlex_token(scanner, &token)) {
+            (*ntokens)++;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        t = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+        if (i == 0 || t < best) {
+            best = t;
+        }
+    }
+    return best;
+}
+
+int main(int argc, char *argv[])
+{
+    ROW *dtrans;
+    accept_t *accept;
+    int nstates;
+    lexer_t *lex;
+    scanner_t *fast;
+    scanner_t *slow;
+    char *buf;
+    long len = 0;
+    long nfast, nslow;
+    double tfast, tslow;
+    int i;
+
+    nstates = dfa(get_expr, &dtrans, &accept);
+
+    /* long comments and runs of blanks between short identifiers, no '*'
+     * in a comment as the rule does not take it */
+    buf = (char *)malloc(SIZE + 512);
+    if (buf == NULL) {
+        fprintf(stderr, "bench_accel: not enough memory\n");
+        return 1;
+    }
+    for (i = 0; len < SIZE; i++) {
+        len += sprintf(buf + len, "%s", (i % 3 == 0) ?
+                       "/* a comment of a few lines, as the ones before\n"
+                       "   functions, with some text in it that goes on\n"
+                       "   for a while before it ends */" :
+                       (i % 3 == 1) ? "\n\n        \t        " : "ident");
+    }
+    buf[len] = SENTINEL;
+
+    fast = zlex_open(dtrans, accept, nstates, NULL, 0);
+    lex = zlex_compile_flags(dtrans, accept, nstates, ZLEX_NO_ACCEL);
+    slow = zlex_cursor(lex, NULL, 0);
+    zlex_lexer_unref(lex);
+
+    tslow = scan_time(slow, buf, len, &nslow);
+    tfast = scan_time(fast, buf, len, &nfast);
+    printf("%ld bytes, %ld tokens\n", len, nfast);
+    printf("plain       %8.1f MB/s\n", len / tslow / 1e6);
+    printf("accelerated %8.1f MB/s\n", len / tfast / 1e6);
+    printf("speedup     %8.2fx%s\n", tslow / tfast,
+           nfast == nslow ? "" : " (token counts differ!)");
+
+    zlex_close(fast);
+    zlex_close(slow);
+    free(dtrans);
+    free(accept);
+    free(buf);
+    return nfast == nslow ? 0 : 1;
+}
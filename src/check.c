@@ -0,0 +1,59 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "scan.h"
+#include "check.h"
+
+/*-----------------------------------------------------------------------------
+ * check.c -- helpers shared by the tests
+ *
+ * Every new engine should give the same results as the DFA it is built from.
+ * Besides the cases of its own, its test runs both over random strings of a
+ * small alphabet, where the short strings cover the corner cases of the
+ * rules much better than any written input.
+ *---------------------------------------------------------------------------*/
+
+int Errors = 0;
+
+void check(const char *name, bool ok)
+{
+    printf(">>> %s --- %s\n", name, ok ? "OK" : "Error");
+    if (!ok) {
+        Errors++;
+    }
+}
+
+bool random_strings(const char *name, const char *alphabet, int max, int n,
+                    unsigned seed, agree_func agree, void *arg)
+{
+    int nchars = strlen(alphabet);
+    char *buf;
+    int len;
+    int errors = 0;
+    int i, j;
+
+    buf = (char *)malloc(max + 1);
+    if (buf == NULL) {
+        fprintf(stderr, "random_strings: not enough memory\n");
+        exit(1);
+    }
+
+    srand(seed);
+    for (i = 0; i < n; i++) {
+        len = rand() % max;
+        for (j = 0; j < len; j++) {
+            buf[j] = alphabet[rand() % nchars];
+        }
+        buf[len] = SENTINEL;
+
+        if (!agree(buf, len, arg)) {
+            printf("Case %d: '%.*s' --- Error\n", i, len, buf);
+            errors++;
+        }
+    }
+
+    free(buf);
+    check(name, errors == 0);
+    return errors == 0;
+}
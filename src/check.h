@@ -0,0 +1,25 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+/*-----------------------------------------------------------------------------
+ * check.h -- helpers shared by the tests
+ *---------------------------------------------------------------------------*/
+#include <stdbool.h>
+
+extern int Errors;      /* number of checks failed */
+
+/* print the result of the check *name*, count it in Errors if not *ok* */
+void check(const char *name, bool ok);
+
+/* tell whether the engine under test agrees with the reference on *buf*.
+ * buf[len] is SENTINEL, the bytes before it could be changed. */
+typedef bool (*agree_func)(char *buf, int len, void *arg);
+
+/* differential test: *n* random strings shorter than *max* bytes of the
+ * characters in *alphabet*, seeded by *seed*. Every string the engine does
+ * not agree on is printed, and the whole is the check *name*. Return true if
+ * all agree. */
+bool random_strings(const char *name, const char *alphabet, int max, int n,
+                    unsigned seed, agree_func agree, void *arg);
+
+#endif /* end of include guard: CHECK_H */
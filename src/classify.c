@@ -0,0 +1,173 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "classify.h"
+
+/*-----------------------------------------------------------------------------
+ * classify.c -- classify many strings by the rules, in parallel
+ *
+ * Classifying a string is a full match of the DFA over it, which only reads
+ * the compiled lexer(see zlex_match()), so any number of threads could share
+ * it without locking. The threads are created once with the classifier and wait
+ * for jobs. A job is split into chunks of CLASSIFY_CHUNK strings, the threads
+ * (and the caller) take the next chunk with an atomic add until none is left,
+ * so a thread that gets short strings simply takes more chunks.
+ *
+ * Small jobs are done by the caller alone, waking the threads would cost
+ * more than the job itself.
+ *---------------------------------------------------------------------------*/
+
+static void *worker(void *arg);
+static void run_job(classify_t *classify);
+
+/*----------------------------------------------------------------------------*/
+/* create a classifier over a lexer with a pool of *nthreads* threads, 0 for one per CPU */
+classify_t *zlex_classify_new(lexer_t *lex, int nthreads)
+{
+    classify_t *classify;
+    int i;
+
+    if (nthreads <= 0) {
+        nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+        if (nthreads <= 0) {
+            nthreads = 1;
+        }
+    }
+
+    classify = (classify_t *)calloc(1, sizeof(*classify));
+    if (classify == NULL) {
+        fprintf(stderr, "zlex_classify_new: not enough memory\n");
+        exit(1);
+    }
+    classify->lex = zlex_lexer_ref(lex);
+    classify->nthreads = nthreads - 1;  /* the caller is one of them */
+    classify->threads = (pthread_t *)malloc((classify->nthreads + 1) *
+                                            sizeof(pthread_t));
+    if (classify->threads == NULL) {
+        fprintf(stderr, "zlex_classify_new: not enough memory for threads\n");
+        exit(1);
+    }
+
+    pthread_mutex_init(&classify->lock, NULL);
+    pthread_cond_init(&classify->work, NULL);
+    pthread_cond_init(&classify->done, NULL);
+
+    for (i = 0; i < classify->nthreads; i++) {
+        if (pthread_create(&classify->threads[i], NULL, worker, classify)) {
+            fprintf(stderr, "zlex_classify_new: can not create thread\n");
+            exit(1);
+        }
+    }
+
+    return classify;
+}
+
+/* stop the threads and destory the classifier */
+void zlex_classify_del(classify_t *classify)
+{
+    int i;
+
+    if (classify == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&classify->lock);
+    classify->quit = true;
+    pthread_cond_broadcast(&classify->work);
+    pthread_mutex_unlock(&classify->lock);
+
+    for (i = 0; i < classify->nthreads; i++) {
+        pthread_join(classify->threads[i], NULL);
+    }
+
+    pthread_mutex_destroy(&classify->lock);
+    pthread_cond_destroy(&classify->work);
+    pthread_cond_destroy(&classify->done);
+    zlex_lexer_unref(classify->lex);
+    free(classify->threads);
+    free(classify);
+}
+
+/*----------------------------------------------------------------------------*/
+/* classify strings[0 ... n-1] into out_rule_ids[] */
+void zlex_classify_many(classify_t *classify, const char *strings[], long n,
+                        int out_rule_ids[])
+{
+    classify->strings = strings;
+    classify->n = n;
+    classify->out = out_rule_ids;
+    classify->next = 0;
+
+    if (classify->nthreads == 0 || n <= CLASSIFY_CHUNK) {
+        run_job(classify);
+        return;
+    }
+
+    pthread_mutex_lock(&classify->lock);
+    classify->busy = classify->nthreads;
+    classify->job++;
+    pthread_cond_broadcast(&classify->work);
+    pthread_mutex_unlock(&classify->lock);
+
+    run_job(classify);
+
+    pthread_mutex_lock(&classify->lock);
+    while (classify->busy > 0) {
+        pthread_cond_wait(&classify->done, &classify->lock);
+    }
+    pthread_mutex_unlock(&classify->lock);
+}
+
+/* take chunks of the current job until none is left */
+static void run_job(classify_t *classify)
+{
+    lexer_t *lex = classify->lex;
+    const char **strings = classify->strings;
+    int *out = classify->out;
+    long n = classify->n;
+    long i, end;
+
+    for (;;) {
+        i = __atomic_fetch_add(&classify->next, CLASSIFY_CHUNK,
+                               __ATOMIC_RELAXED);
+        if (i >= n) {
+            break;
+        }
+        end = (i + CLASSIFY_CHUNK < n) ? i + CLASSIFY_CHUNK : n;
+        for (; i < end; i++) {
+            out[i] = zlex_match(lex, strings[i], strlen(strings[i]));
+        }
+    }
+}
+
+/* wait for jobs and work on them until the pool quits */
+static void *worker(void *arg)
+{
+    classify_t *classify = (classify_t *)arg;
+    unsigned long seen = 0;
+
+    for (;;) {
+        pthread_mutex_lock(&classify->lock);
+        while (classify->job == seen && !classify->quit) {
+            pthread_cond_wait(&classify->work, &classify->lock);
+        }
+        if (classify->quit) {
+            pthread_mutex_unlock(&classify->lock);
+            break;
+        }
+        seen = classify->job;
+        pthread_mutex_unlock(&classify->lock);
+
+        run_job(classify);
+
+        pthread_mutex_lock(&classify->lock);
+        if (--classify->busy == 0) {
+            pthread_cond_signal(&classify->done);
+        }
+        pthread_mutex_unlock(&classify->lock);
+    }
+
+    return NULL;
+}
@@ -0,0 +1,47 @@
+#ifndef CLASSIFY_H
+#define CLASSIFY_H
+
+/*-----------------------------------------------------------------------------
+ * classify.h -- classify many strings by the rules, in parallel
+ *---------------------------------------------------------------------------*/
+#include <pthread.h>
+#include <stdbool.h>
+#include "scan.h"
+
+#define CLASSIFY_CHUNK 1024 /* strings taken by a thread at a time */
+
+typedef struct classify
+{
+    lexer_t *lex;           /* the tables, shared by all the threads */
+    pthread_t *threads;     /* the worker threads */
+    int nthreads;           /* number of worker threads */
+
+    pthread_mutex_t lock;
+    pthread_cond_t work;    /* a job is posted, or the pool quits */
+    pthread_cond_t done;    /* all workers finished the job */
+    unsigned long job;      /* number of jobs posted */
+    int busy;               /* workers still on the current job */
+    bool quit;
+
+    const char **strings;   /* the current job */
+    long n;
+    int *out;
+    long next;              /* first string not taken yet, taken atomically */
+} classify_t;
+
+/*----------------------------------------------------------------------------*/
+/* create a classifier over a compiled lexer with a pool of *nthreads*
+ * worker threads, 0 for one per CPU. The caller's thread works too, so 1
+ * means no extra thread. The classifier takes a reference of the lexer. */
+classify_t *zlex_classify_new(lexer_t *lex, int nthreads);
+
+/* stop the threads and destory the classifier */
+void zlex_classify_del(classify_t *classify);
+
+/* classify strings[0 ... n-1]: out_rule_ids[i] is the rule number that
+ * matches the whole of strings[i](an anchored full match), F if none. Nothing
+ * is allocated. A classifier runs one call at a time. */
+void zlex_classify_many(classify_t *classify, const char *strings[], long n,
+                        int out_rule_ids[]);
+
+#endif /* end of include guard: CLASSIFY_H */
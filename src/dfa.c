@@ -26,7 +26,11 @@ typedef struct dfa_state {
     unsigned group; /* group id, used by minimize() */
     bool mark; /* mark used by make_dtran() */
     char *accept; /* acception string if accept state */
+    char *eol; /* acception string if followed by a newline, NULL if the same
+                * as accept */
     anchor_t anchor; /* anchor point if accpet state */
+    int bol; /* the state to start from at the beginning of a line instead of
+              * this one, itself if the same */
     set_t *set;  /* set of NFA states represented by current DFA states */
 }dfa_t;
 
@@ -35,15 +39,19 @@ static dfa_t *Dstates; /* DFA states table */
 static ROW *Dtrans; /* DFA transition table */
 static int Nstates; /* number of DFA states */
 static dfa_t *Last_marked; /* most-recently marked DFA state in Dtrans */
+static int Nconds; /* number of start conditions, DFA state c is the start
+                    * state of condition c */
+static char **Cond_names; /* names of the start conditions */
 
 /*----------------------------------------------------------------------------*/
 /* Prototypes for subroutines in this file */
 
-int add_to_dstates(set_t *nfa_set, char *accepting_string, anchor_t anchor);
+int add_to_dstates(set_t *nfa_set, char *accepting_string, char *eol,
+                   anchor_t anchor);
 static int in_dstates(set_t *nfa_set);
 static dfa_t *get_unmarked();
 static void free_sets();
-static void make_dtrans(int start);
+static void make_dtrans(int starts[], int nconds, int nextra);
 
 /*----------------------------------------------------------------------------*/
 
@@ -55,20 +63,45 @@ static void make_dtrans(int start);
 int dfa(char *(*input_func)(void), ROW *dtrans[], accept_t **accept)
 {
     accept_t *accept_states;
-    int i;
-    int start;
-
-    start = nfa(input_func);
+    nfa_t **cond_starts;
+    nfa_t **cond_bol;
+    trail_t *trails;
+    int ntrails;
+    int *starts;
+    bool *copied;       /* does trail i have copies to run on their own */
+    int nextra = 0;
+    int i, j;
+
+    nfa(input_func);
+    Nconds = thompson_conds(&cond_starts, &cond_bol, &Cond_names);
+    ntrails = thompson_trails(&trails);
+    starts = (int *)malloc((Nconds + ntrails) * 2 * sizeof(int));
+    copied = (bool *)malloc((ntrails + 1) * sizeof(bool));
     Nstates = 0;
     Dstates = (dfa_t *)calloc(MAX_DFA_STATES, sizeof(*Dstates));
     Dtrans = (ROW *)calloc(MAX_NFA_STATES, sizeof(ROW));
 
-    if (Dtrans == NULL || Dstates == NULL) {
+    if (Dtrans == NULL || Dstates == NULL || starts == NULL ||
+        copied == NULL) {
         fprintf(stderr, "dfa: not enough memory allocating Dstates or Dtrans\n");
         exit(1);
     }
 
-    make_dtrans(start); /* convert the NFA to a DFA */
+    for (i = 0; i < Nconds; i++) {
+        starts[i] = cond_starts[i]->nfa_id;
+        starts[Nconds + i] = cond_bol[i]->nfa_id;
+    }
+    for (i = 0; i < ntrails; i++) {
+        copied[i] = trails[i].head_start != NULL;
+        if (copied[i]) {
+            starts[2*Nconds + nextra++] = trails[i].head_start->nfa_id;
+            starts[2*Nconds + nextra++] = trails[i].tail_start->nfa_id;
+        }
+    }
+    /* the subset construction runs on the compact layout alone */
+    destory_thompson_states();
+
+    make_dtrans(starts, Nconds, nextra); /* convert the NFA to a DFA */
     free_nfa();
     
     /* reallocate memory for states/accept/... */
@@ -82,8 +115,33 @@ int dfa(char *(*input_func)(void), ROW *dtrans[], accept_t **accept)
     for (i = Nstates-1; i >= 0; i--) {
         accept_states[i].string = Dstates[i].accept;
         accept_states[i].anchor = Dstates[i].anchor;
+        accept_states[i].rule = Dstates[i].accept ?
+                                ACCEPT_RULE(Dstates[i].accept) : F;
+        accept_states[i].eol = Dstates[i].eol;
+        accept_states[i].eol_rule = Dstates[i].eol ?
+                                    ACCEPT_RULE(Dstates[i].eol) :
+                                    accept_states[i].rule;
+        accept_states[i].bol = Dstates[i].bol;
+
+        accept_states[i].head = accept_states[i].tail = 0;
+        accept_states[i].head_start = accept_states[i].tail_start = F;
+        for (j = 0, nextra = 0; j < ntrails; j++) {
+            if (trails[j].rule == accept_states[i].rule) {
+                accept_states[i].head = trails[j].head;
+                accept_states[i].tail = trails[j].tail;
+                if (copied[j]) {
+                    accept_states[i].head_start = starts[2*Nconds + nextra];
+                    accept_states[i].tail_start = starts[2*Nconds + nextra+1];
+                }
+            }
+            if (copied[j]) {
+                nextra += 2;
+            }
+        }
     }
 
+    free(starts);
+    free(copied);
     free(Dstates);
     *dtrans = Dtrans;
     *accept = accept_states;
@@ -91,10 +149,21 @@ int dfa(char *(*input_func)(void), ROW *dtrans[], accept_t **accept)
     return Nstates;
 }
 
+/* Return the number of start conditions of the DFA made by the last dfa(),
+ * states 0 ... n-1 are their start states. *names* is set to their names. */
+int dfa_conds(char ***names)
+{
+    if (names != NULL) {
+        *names = Cond_names;
+    }
+    return Nconds;
+}
+
 /*----------------------------------------------------------------------------*/
 /* Add a new DFA state to the Dstates array and increments the *Nstates*
  * counter. the index of the new state in the array is returned. */
-int add_to_dstates(set_t *nfa_set, char *accepting_string, anchor_t anchor)
+int add_to_dstates(set_t *nfa_set, char *accepting_string, char *eol,
+                   anchor_t anchor)
 {
     int next_state;
 
@@ -107,7 +176,9 @@ int add_to_dstates(set_t *nfa_set, char *accepting_string, anchor_t anchor)
 
     Dstates[next_state].set = nfa_set;
     Dstates[next_state].accept = accepting_string;
+    Dstates[next_state].eol = eol;
     Dstates[next_state].anchor = anchor;
+    Dstates[next_state].bol = next_state;
     
     return next_state;
 }
@@ -136,9 +207,8 @@ static dfa_t *get_unmarked()
         if (!Last_marked->mark) {
             putc('*', stderr);
             fflush(stderr);
+            return Last_marked;
         }
-
-        return Last_marked;
     }
 
     return NULL;
@@ -157,24 +227,44 @@ static void free_sets()
 /*----------------------------------------------------------------------------*/
 /* Actually perform the transformation of NFA machine to DFA transition
  * table. The resources (such as Dtrans/Dstates array) should be made available
- * before this function is called. */
-static void make_dtrans(int start)
+ * before this function is called. *starts* are the NFA start states of the
+ * conditions, then the ones at the beginning of a line, then *nextra* more
+ * for the trailing contexts, which are replaced by their DFA states. */
+static void make_dtrans(int starts[], int nconds, int nextra)
 {
     set_t *nfa_set; /* set of NFA states that define the next DFA state. */
     dfa_t *current; /* state currently being expanded. */
     int next_state; /* Goto DFA state for current char, i.e. Dtrans[cur][c] */
     char *accept; /* accept string, NULL if not accepting state */
+    char *eol; /* accept string before a newline */
+    int bol; /* start state at the beginning of a line */
 
     anchor_t anchor; /* anchor point if any */
     int c; /* current input character */
 
-    /* 1. Initialize the starting DFA state */
-    nfa_set = set_new();
-    set_add(nfa_set, start);
-
-    Nstates = 1;
-    Dstates[0].set = e_closure(nfa_set, &accept, &anchor);
-    Dstates[0].mark = false;
+    /* 1. Initialize the starting DFA states, one for each start condition,
+     * followed by the ones at the beginning of a line. The latter are only
+     * added if they differ, i.e. the condition has rules anchored by ^. The
+     * extra ones of the trailing contexts come last. */
+    Nstates = 0;
+    for (c = 0; c < nconds * 2 + nextra; c++) {
+        nfa_set = set_new();
+        set_add(nfa_set, starts[c]);
+        nfa_set = e_closure(nfa_set, &accept, &anchor);
+        accepts(nfa_set, &accept, &eol);
+
+        if (c >= nconds && (bol = in_dstates(nfa_set)) != -1) {
+            set_del(nfa_set);
+        } else {
+            bol = add_to_dstates(nfa_set, accept, eol, anchor);
+        }
+        if (c >= nconds * 2) {
+            starts[c] = bol;
+        } else if (c >= nconds) {
+            Dstates[c - nconds].bol = bol;
+        }
+    }
+    Last_marked = Dstates;
 
     while ((current = get_unmarked()) != NULL) {
         current->mark = true;
@@ -183,6 +273,7 @@ static void make_dtrans(int start)
             nfa_set = move(current->set, c);
             if (nfa_set != NULL) {
                 nfa_set = e_closure(nfa_set, &accept, &anchor);
+                accepts(nfa_set, &accept, &eol);
             }
 
             /* no outgoing transition */
@@ -192,7 +283,7 @@ static void make_dtrans(int start)
                 /* the GOTO state is already exist. */
                 set_del(nfa_set);
             } else {
-                next_state = add_to_dstates(nfa_set, accept, anchor);
+                next_state = add_to_dstates(nfa_set, accept, eol, anchor);
             }
 
             Dtrans[current-Dstates][c] = next_state;
@@ -24,11 +24,28 @@ typedef struct
 {
     char *string; /* accepting string, NULL if not an accept state */
     anchor_t anchor; /* anchor point. if any */
+    int rule; /* rule number of the accepting string, F if not an accept
+               * state */
+    char *eol; /* accepting string if the next character is a newline, it
+                * comes from a rule anchored by $. NULL if the same as
+                * *string* */
+    int eol_rule; /* rule number of *eol*, *rule* if *eol* is NULL */
+    int bol; /* the state to start from at the beginning of a line instead of
+              * this one, itself if the same. Only differs for the start
+              * states of conditions having rules anchored by ^ */
+    int head; /* trailing context r/s of *rule*: the length of r if it is
+               * fixed, -1 otherwise */
+    int tail; /* the length of s if it is fixed, -1 otherwise, 0 if the rule
+               * has no trailing context */
+    int head_start; /* both lengths vary: the state to run r alone from, F
+                     * otherwise */
+    int tail_start; /* and the state to run s reversed from */
 } accept_t;
 
 /*----------------------------------------------------------------------------*/
 /* External subroutines */
 int dfa(char *(*input_func)(void), ROW*dtrans[], accept_t **accept); /* dfa.c */
 int min_dfa(char *(*input_func)(void), ROW*[], accept_t **accept); /* minimiz.c */
+int dfa_conds(char ***names); /* dfa.c, start conditions of the last DFA */
 
 #endif /* DFA_H */
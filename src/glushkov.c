@@ -0,0 +1,242 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "nfa.h"
+#include "glushkov.h"
+
+/*-----------------------------------------------------------------------------
+ * glushkov.c -- bit-parallel simulation of small position automata
+ *
+ * The positions of the Glushkov automaton are the characters and classes of
+ * the rules, i.e. the states of the Thompson NFA that read a character. The
+ * automaton is in a set of positions: the ones that read the last byte. From
+ * there it goes on with the positions that could follow them(those in the
+ * EPSILON closure of their next states) which read the next byte. With at
+ * most 64 positions the set is a single word, and a step is
+ *
+ *     d = follow(d) & mask[c];
+ *
+ * where mask[c] are the positions that read byte c. follow(d) is the union of
+ * the follow sets of the positions in d, looked up 8 bits at a time: eight
+ * tables of 256 words, 16KB in all. There is no subset construction at all,
+ * so the automaton is built in time linear in the size of the NFA, which
+ * suits patterns that are used only a few times.
+ *
+ * Like the DFA, the rule accepted is the one of the accepting state of the
+ * lowest ID among the positions a rule could end with. Bytes >= MAX_CHARS never match.
+ *---------------------------------------------------------------------------*/
+
+static uint64_t closure(nfa_t *states, int max_state, nfa_t *from,
+                        const int *pos, int *rule, int *accept);
+static inline uint64_t follow(const glushkov_t *g, uint64_t d);
+static inline int lowest_rule(const glushkov_t *g, uint64_t d);
+
+#define LABELED(p) ((p)->edge >= 0 || (p)->edge == CCL)
+
+/*----------------------------------------------------------------------------*/
+/* build the position automaton of the rules read by *input_func* */
+glushkov_t *glushkov_new(char *(*input_func)(void))
+{
+    glushkov_t *g = NULL;
+    nfa_t *states;
+    nfa_t *start;
+    nfa_t **starts;
+    nfa_t **bol_starts;
+    trail_t *trails;
+    uint64_t follows[GLUSHKOV_POSITIONS];
+    int *pos;   /* position of every state, -1 if it reads no character */
+    int max_state;
+    int npos = 0;
+    int i, k, b, c;
+    nfa_t *p;
+
+    states = thompson(input_func, &start, &max_state);
+    if (thompson_conds(&starts, &bol_starts, NULL) > 1 ||
+        bol_starts[0] != starts[0] || thompson_trails(&trails) > 0) {
+        goto exit;
+    }
+
+    pos = (int *)malloc(max_state * sizeof(int));
+    if (pos == NULL) {
+        fprintf(stderr, "glushkov_new: not enough memory\n");
+        exit(1);
+    }
+    for (i = 0; i < max_state; i++) {
+        if (states[i].accept != NULL && (states[i].anchor & END)) {
+            break;  /* $ */
+        }
+        pos[i] = LABELED(&states[i]) ? npos++ : -1;
+    }
+    if (i < max_state || npos > GLUSHKOV_POSITIONS) {
+        free(pos);
+        goto exit;
+    }
+
+    g = (glushkov_t *)calloc(1, sizeof(*g));
+    if (g == NULL) {
+        fprintf(stderr, "glushkov_new: not enough memory\n");
+        exit(1);
+    }
+    g->npos = npos;
+    g->first = closure(states, max_state, start, pos, &g->empty, &k);
+
+    for (i = 0; i < max_state; i++) {
+        p = &states[i];
+        if (pos[i] < 0) {
+            continue;
+        }
+        follows[pos[i]] = closure(states, max_state, p->next1, pos,
+                                  &g->rule[pos[i]], &g->accept[pos[i]]);
+        if (g->rule[pos[i]] != F) {
+            g->last |= 1ull << pos[i];
+        }
+        for (c = 0; c < MAX_CHARS; c++) {
+            int fc = p->fold ? FOLD(c) : c;
+            if (p->edge == fc ||
+                (p->edge == CCL && set_is_member(p->bitset, fc))) {
+                g->mask[c] |= 1ull << pos[i];
+            }
+        }
+    }
+
+    for (k = 0; k < GLUSHKOV_POSITIONS/8; k++) {
+        for (b = 0; b < 256; b++) {
+            for (i = 0; i < 8 && k*8 + i < npos; i++) {
+                if (b & (1 << i)) {
+                    g->follow[k][b] |= follows[k*8 + i];
+                }
+            }
+        }
+    }
+    free(pos);
+
+exit:
+    thompson_free_strings();    /* the rule numbers are copied */
+    destory_thompson();
+    return g;
+}
+
+/* destory the automaton */
+void glushkov_del(glushkov_t *g)
+{
+    free(g);
+}
+
+/* return the positions in the EPSILON closure of *from*, *accept* is set to
+ * the accepting state of the highest priority in it, max_state if none, and
+ * *rule* to its rule, F if none */
+static uint64_t closure(nfa_t *states, int max_state, nfa_t *from,
+                        const int *pos, int *rule, int *accept)
+{
+    nfa_t **stack;
+    bool *seen;
+    uint64_t d = 0;
+    int top = 0;
+    nfa_t *p;
+
+    stack = (nfa_t **)malloc(max_state * sizeof(nfa_t *));
+    seen = (bool *)calloc(max_state, sizeof(bool));
+    if (stack == NULL || seen == NULL) {
+        fprintf(stderr, "closure: not enough memory\n");
+        exit(1);
+    }
+
+    *accept = max_state;
+    seen[from->nfa_id] = true;
+    stack[top++] = from;
+    while (top > 0) {
+        p = stack[--top];
+        if (pos[p->nfa_id] >= 0) {
+            d |= 1ull << pos[p->nfa_id];
+            continue;
+        }
+        if (p->accept != NULL && p->nfa_id < *accept) {
+            *accept = p->nfa_id;
+        }
+        if (p->edge != EPSILON) {
+            continue;
+        }
+        if (p->next1 != NULL && !seen[p->next1->nfa_id]) {
+            seen[p->next1->nfa_id] = true;
+            stack[top++] = p->next1;
+        }
+        if (p->next2 != NULL && !seen[p->next2->nfa_id]) {
+            seen[p->next2->nfa_id] = true;
+            stack[top++] = p->next2;
+        }
+    }
+
+    *rule = *accept < max_state ? ACCEPT_RULE(states[*accept].accept) : F;
+    free(stack);
+    free(seen);
+    return d;
+}
+
+/*----------------------------------------------------------------------------*/
+/* the positions that could follow the ones in *d* */
+static inline uint64_t follow(const glushkov_t *g, uint64_t d)
+{
+    uint64_t next = 0;
+    int k;
+
+    for (k = 0; d != 0; k++, d >>= 8) {
+        next |= g->follow[k][d & 0xff];
+    }
+    return next;
+}
+
+/* the rule of the highest priority of the last positions in *d*, F if none */
+static inline int lowest_rule(const glushkov_t *g, uint64_t d)
+{
+    int best = -1;
+    int p;
+
+    for (; d != 0; d &= d - 1) {
+        p = __builtin_ctzll(d);
+        if (best < 0 || g->accept[p] < g->accept[best]) {
+            best = p;
+        }
+    }
+    return best < 0 ? F : g->rule[best];
+}
+
+/* run the automaton over the whole of *buf*(an anchored full match) */
+int glushkov_match(const glushkov_t *g, const char *buf, long len)
+{
+    const unsigned char *s = (const unsigned char *)buf;
+    uint64_t d;
+    long i;
+
+    if (len == 0) {
+        return g->empty;
+    }
+    d = g->first & g->mask[s[0]];
+    for (i = 1; i < len && d != 0; i++) {
+        d = follow(g, d) & g->mask[s[i]];
+    }
+    return lowest_rule(g, d & g->last);
+}
+
+/* find the first match anywhere in *buf*: every byte may also start one */
+long glushkov_search(const glushkov_t *g, const char *buf, long len,
+                     int *rule)
+{
+    const unsigned char *s = (const unsigned char *)buf;
+    uint64_t d = 0;
+    long i;
+
+    if (g->empty != F) {
+        *rule = g->empty;
+        return 0;
+    }
+    for (i = 0; i < len; i++) {
+        d = (follow(g, d) | g->first) & g->mask[s[i]];
+        if (d & g->last) {
+            *rule = lowest_rule(g, d & g->last);
+            return i + 1;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,53 @@
+#ifndef GLUSHKOV_H
+#define GLUSHKOV_H
+
+/*-----------------------------------------------------------------------------
+ * glushkov.h -- bit-parallel simulation of small position automata
+ *---------------------------------------------------------------------------*/
+#include <stdint.h>
+#include "dfa.h"
+#include "scan.h"
+
+#define GLUSHKOV_POSITIONS 64   /* max positions, one bit each in a word */
+
+typedef struct glushkov
+{
+    uint64_t first;         /* positions the rules start with */
+    uint64_t last;          /* positions a rule could end with */
+    uint64_t mask[MAX_BYTES];   /* positions whose character class has the
+                                 * byte */
+    uint64_t follow[GLUSHKOV_POSITIONS/8][256];
+                            /* follow[k][b]: the positions that could follow
+                             * the ones of the bits of *b*, which are the
+                             * positions 8k to 8k+7 */
+    int rule[GLUSHKOV_POSITIONS];   /* rule number accepted after each last
+                                     * position */
+    int accept[GLUSHKOV_POSITIONS]; /* ID of the accepting state of it, the
+                                     * lowest ID has the highest priority */
+    int empty;              /* rule number matching the empty string, F if
+                             * none */
+    int npos;               /* number of positions */
+} glushkov_t;
+
+/*----------------------------------------------------------------------------*/
+/* build the position automaton of the rules read by *input_func*, the same
+ * specification as thompson() takes. Return NULL if it has more than
+ * GLUSHKOV_POSITIONS positions, or uses start conditions, anchors or
+ * trailing context. */
+glushkov_t *glushkov_new(char *(*input_func)(void));
+
+/* destory the automaton */
+void glushkov_del(glushkov_t *g);
+
+/* run the automaton over the whole of *buf*(an anchored full match), return
+ * the rule number it accepts, F if none. The same as zlex_match() on the
+ * DFA of the rules. */
+int glushkov_match(const glushkov_t *g, const char *buf, long len);
+
+/* find the first match anywhere in *buf*, return the offset of its end or
+ * -1 if there is none. *rule* is set to the rule number of the match, the
+ * first rule if several rules end there. */
+long glushkov_search(const glushkov_t *g, const char *buf, long len,
+                     int *rule);
+
+#endif /* end of include guard: GLUSHKOV_H */
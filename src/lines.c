@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "lines.h"
+
+/*-----------------------------------------------------------------------------
+ * Implementation file of the newline index
+ *
+ * Newlines are found 16 bytes at a time with SSE2: compare the bytes with
+ * '\n' and take the mask of the result, every set bit in the mask is a
+ * newline. Plain C is used for the tail, and for all the input if SSE2 is
+ * not available.
+ *---------------------------------------------------------------------------*/
+
+static inline void add(lines_t *lines, long offset)
+{
+    if (lines->n >= lines->size) {
+        lines->size = lines->size ? lines->size * 2 : 256;
+        lines->nl = (long *)realloc(lines->nl, lines->size * sizeof(long));
+        if (lines->nl == NULL) {
+            fprintf(stderr, "add: not enough memory enlarging line index\n");
+            exit(1);
+        }
+    }
+    lines->nl[lines->n++] = offset;
+}
+
+/*---------------------------------------------------------------------------*/
+/* create an empty index */
+lines_t *lines_new(void)
+{
+    lines_t *lines = (lines_t *)calloc(1, sizeof(*lines));
+    if (lines == NULL) {
+        fprintf(stderr, "lines_new: not enough memory allocating line index\n");
+        exit(1);
+    }
+    return lines;
+}
+
+/* destory an index */
+void lines_del(lines_t *lines)
+{
+    if (lines == NULL) {
+        return;
+    }
+    free(lines->nl);
+    free(lines);
+}
+
+/* forget all the newlines, start over from offset 0 */
+void lines_clear(lines_t *lines)
+{
+    lines->n = 0;
+    lines->indexed = 0;
+}
+
+/* record the newlines of *buf*, which is at offset *base* of the input. */
+void lines_index(lines_t *lines, const char *buf, long len, long base)
+{
+    long i = 0;
+
+#ifdef __SSE2__
+    const __m128i newline = _mm_set1_epi8('\n');
+    __m128i chunk;
+    unsigned mask;
+
+    for (; i + 16 <= len; i += 16) {
+        chunk = _mm_loadu_si128((const __m128i *)(buf + i));
+        mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline));
+        while (mask != 0) {
+            add(lines, base + i + __builtin_ctz(mask));
+            mask &= mask - 1;
+        }
+    }
+#endif
+
+    for (; i < len; i++) {
+        if (buf[i] == '\n') {
+            add(lines, base + i);
+        }
+    }
+
+    lines->indexed = base + len;
+}
+
+/* resolve *offset* into line and column numbers, both start from 1. */
+void lines_position(lines_t *lines, long offset, int *line, int *column)
+{
+    int lo = 0;
+    int hi = lines->n;
+    int mid;
+
+    /* count the newlines before offset */
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (lines->nl[mid] < offset) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    *line = lo + 1;
+    *column = (lo > 0) ? offset - lines->nl[lo-1] : offset + 1;
+}
@@ -0,0 +1,36 @@
+#ifndef LINES_H
+#define LINES_H
+
+/*-----------------------------------------------------------------------------
+ * Library: newline index
+ * Record the offsets of newlines in the input, so that an offset could be
+ * resolved into line and column numbers by binary search.
+ *---------------------------------------------------------------------------*/
+
+typedef struct lines
+{
+    long *nl;       /* offsets of the newlines, in increasing order */
+    int n;          /* number of newlines recorded */
+    int size;       /* allocated size of nl */
+    long indexed;   /* the input before this offset is indexed */
+} lines_t;
+
+/*---------------------------------------------------------------------------*/
+/* create an empty index */
+lines_t *lines_new(void);
+
+/* destory an index */
+void lines_del(lines_t *lines);
+
+/* forget all the newlines, start over from offset 0 */
+void lines_clear(lines_t *lines);
+
+/* record the newlines of *buf*, which is at offset *base* of the input.
+ * Buffers should be indexed in order, base == lines->indexed. */
+void lines_index(lines_t *lines, const char *buf, long len, long base);
+
+/* resolve *offset* into line and column numbers, both start from 1. The
+ * input before *offset* should be indexed. */
+void lines_position(lines_t *lines, long offset, int *line, int *column);
+
+#endif /* end of include guard: LINES_H */
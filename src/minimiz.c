@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dfa.h"
+
+/*-----------------------------------------------------------------------------
+ * minimiz.c -- Make a minimal DFA by eliminating equivalent states.
+ *
+ * The states are first partitioned by what they accept: all non-accepting
+ * states in one group, accepting states in one group per accepting strings
+ * (with or without a newline following) and anchor. The start state of every
+ * start condition is kept in a group of its own, so that they stay apart.
+ * Then groups are split repeatedly: two states stay in the same group only if
+ * they go to the same group on every input character. When no group is split
+ * any more, every group becomes a state of the new DFA.
+ *
+ * Groups are numbered in the order of their first state, so the start state
+ * of condition c is still state c.
+ *---------------------------------------------------------------------------*/
+
+static int *Group;      /* group of each state */
+static int *New_group;  /* group of each state after a split */
+static int *First;      /* first state(representative) of each new group */
+
+static bool same_group(ROW *dtrans, int a, int b);
+static int split(ROW *dtrans, accept_t *accept, int nstates, int nconds,
+                 bool initial);
+
+/*----------------------------------------------------------------------------*/
+/* Same as dfa(), but the returned DFA is minimized. */
+int min_dfa(char *(*input_func)(void), ROW *dtrans[], accept_t **accept)
+{
+    ROW *old_trans;
+    accept_t *old_accept;
+    ROW *new_trans;
+    accept_t *new_accept;
+    int nstates;
+    int nconds;
+    int ngroups;
+    int old_ngroups;
+    int state;
+    int c;
+
+    nstates = dfa(input_func, &old_trans, &old_accept);
+    nconds = dfa_conds(NULL);
+
+    Group = (int *)malloc(nstates * sizeof(int));
+    New_group = (int *)malloc(nstates * sizeof(int));
+    First = (int *)malloc(nstates * sizeof(int));
+    if (Group == NULL || New_group == NULL || First == NULL) {
+        fprintf(stderr, "min_dfa: not enough memory allocating groups\n");
+        exit(1);
+    }
+
+    ngroups = split(old_trans, old_accept, nstates, nconds, true);
+    do {
+        old_ngroups = ngroups;
+        ngroups = split(old_trans, old_accept, nstates, nconds, false);
+    } while (ngroups != old_ngroups);
+
+    /* build the new table from the first state of every group */
+    new_trans = (ROW *)malloc(ngroups * sizeof(ROW));
+    new_accept = (accept_t *)malloc(ngroups * sizeof(accept_t));
+    if (new_trans == NULL || new_accept == NULL) {
+        fprintf(stderr, "min_dfa: not enough memory allocating new DFA\n");
+        exit(1);
+    }
+
+    for (state = 0; state < ngroups; state++) {
+        for (c = 0; c < MAX_CHARS; c++) {
+            int next = old_trans[First[state]][c];
+            new_trans[state][c] = (next == F) ? F : Group[next];
+        }
+        new_accept[state] = old_accept[First[state]];
+        new_accept[state].bol = Group[new_accept[state].bol];
+        if (new_accept[state].head_start != F) {
+            new_accept[state].head_start = Group[new_accept[state].head_start];
+            new_accept[state].tail_start = Group[new_accept[state].tail_start];
+        }
+    }
+
+    free(old_trans);
+    free(old_accept);
+    free(Group);
+    free(New_group);
+    free(First);
+
+    *dtrans = new_trans;
+    *accept = new_accept;
+    return ngroups;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Split the groups(or make the initial groups if *initial*), the result is
+ * left in Group. Return the number of groups. */
+static int split(ROW *dtrans, accept_t *accept, int nstates, int nconds,
+                 bool initial)
+{
+    int ngroups = 0;
+    int state;
+    int g;
+
+    for (state = 0; state < nstates; state++) {
+        for (g = (state < nconds) ? ngroups : 0; g < ngroups; g++) {
+            int first = First[g];
+            if (first < nconds) {
+                continue;   /* a start state is alone */
+            } else if (initial) {
+                if (accept[first].string == accept[state].string &&
+                    accept[first].eol == accept[state].eol &&
+                    accept[first].anchor == accept[state].anchor) {
+                    break;
+                }
+            } else if (Group[first] == Group[state] &&
+                       same_group(dtrans, first, state)) {
+                break;
+            }
+        }
+
+        if (g == ngroups) { /* a new group */
+            First[ngroups++] = state;
+        }
+        New_group[state] = g;
+    }
+
+    memcpy(Group, New_group, nstates * sizeof(int));
+    return ngroups;
+}
+
+/* return true if states *a* and *b* go to the same group on every input */
+static bool same_group(ROW *dtrans, int a, int b)
+{
+    int c;
+    int na, nb;
+
+    for (c = 0; c < MAX_CHARS; c++) {
+        na = dtrans[a][c];
+        nb = dtrans[b][c];
+        if (na != nb && (na == F || nb == F || Group[na] != Group[nb])) {
+            return false;
+        }
+    }
+    return true;
+}
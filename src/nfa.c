@@ -44,6 +44,7 @@ enum token {
     OPTIONAL,    /* ?                  */
     OR,          /* |                  */
     PLUS_CLOSE,  /* +                  */
+    TRAIL,       /* /                  */
 };
 
 /*---------------------------------------------------------------------------*/
@@ -54,19 +55,37 @@ static inline bool match(enum token t);
 
 /* parser */
 static nfa_t *machine();
-static nfa_t *rule();
+static int merge_prefix(nfa_t **list, int n, const int *indegree, int in);
+static nfa_t *follow(nfa_t *p, const int *indegree, bool discard);
+static nfa_t *alternate(nfa_t **list, int n);
+static bool declaration(void);
+static nfa_t *rule(unsigned *conds, anchor_t *anchor);
+static bool cond_prefix(unsigned *conds);
+static int find_cond(const char *name, int len);
 static void expr(nfa_t **start, nfa_t **end);
 static void cat_expr(nfa_t **start, nfa_t **end);
 static void factor(nfa_t **start, nfa_t **end);
+static void repeat(nfa_t **start, nfa_t **end, int size);
 static bool first_in_cat(enum token t);
 static void term(nfa_t **start, nfa_t **end);
 static void dodash(set_t *set);
+static void fold_set(set_t *set);
+static int intern_ccl(set_t *set);
+static void option(char *p);
+static void trail(nfa_t *start, nfa_t *end, nfa_t *tail_start,
+                  nfa_t *tail_end, char *accept);
+static int fixed_len(nfa_t *start, nfa_t *end);
+static void copy(nfa_t *start, nfa_t *end, nfa_t **cstart, nfa_t **cend,
+                 bool reverse);
+static void add_edge(nfa_t *state, nfa_t *next);
+static void compact(void);
+static nfa_t *skip_links(nfa_t *p);
 
 /* memory management */
 static nfa_t *new_state(void);
 static void discard_state(nfa_t *state);
 static void assign_state(nfa_t **dst, const nfa_t *src);
-static char *save(char *str);
+static char *save(char *str, bool share);
 
 /* macro support */
 static char *expand_macro(char **input);
@@ -84,8 +103,8 @@ static enum token Tokmap[] = {
     L,  L,  L,  L,  L,  L,  AT_EOL,  L,  L,  L,
 /*  (           )            *        +           '  -     .   */
     PAREN_OPEN, PAREN_CLOSE, CLOSURE, PLUS_CLOSE, L, DASH, ANY,
-/*  /   0   1   2   3   4   5   6   7   8   9   :   ;   <   = */
-    L,  L,  L,  L,  L,  L,  L,  L,  L,  L,  L,  L,  L,  L,  L,
+/*  /      0   1   2   3   4   5   6   7   8   9   :   ;   <   = */
+    TRAIL, L,  L,  L,  L,  L,  L,  L,  L,  L,  L,  L,  L,  L,  L,
 /*  >   ?        */
     L,  OPTIONAL,
 /*  @   A   B   C   D   E   F   G   H   I   J   K   L   M   N */
@@ -108,6 +127,31 @@ static char *Input_str = NULL;  /* beginning of input string */
 static enum token Current_tok;  /* current token */
 static int  Lexeme;             /* value associated with literal */
 static char *(*Input_func)() = NULL; /* function to get input string */
+static int  Rule_num = 0;       /* number of the rule being parsed */
+static int  Lineno = 0;         /* number of lines read by Input_func() */
+
+/* start conditions, condition 0 is INITIAL */
+static int  Nconds = 1;                 /* number of start conditions */
+static char *Cond_names[MAX_CONDS] = {"INITIAL"};
+static nfa_t *Cond_start[MAX_CONDS];    /* start state of each condition */
+static nfa_t *Cond_bol[MAX_CONDS];      /* start state of each condition at
+                                         * the beginning of a line */
+static unsigned Inclusive = 1;  /* the conditions that take rules without a
+                                 * prefix, bit c for condition c */
+#define ALL_CONDS (Nconds == 32 ? ~0u : (1u << Nconds) - 1)
+
+static trail_t *Trails = NULL;  /* rules with trailing context */
+static int Ntrails = 0;         /* number of them */
+static int Trails_size = 0;     /* allocated size of Trails */
+
+static hash_t *Ccl_table = NULL;    /* interned classes: set -> ID */
+static set_t **Ccls = NULL;     /* the classes, indexed by the ID */
+static int Nccls = 0;           /* number of them */
+static int Ccls_size = 0;       /* allocated size of Ccls */
+
+static bool Caseless = false;   /* %option case-insensitive */
+static bool Shared = false;     /* %option shared-actions */
+static bool Fold = false;       /* the terms being parsed are case-insensitive */
 
 /*---------------------------------------------------------------------------*/
 /* Lexical analyzer
@@ -141,6 +185,7 @@ static int advance()
 
         do {
             Input_pos = Input_func();
+            Lineno++;
             if (Input_pos == NULL) {    /* end of file */
                 Current_tok = END_OF_INPUT;
                 goto exit;
@@ -152,12 +197,9 @@ static int advance()
         Input_str = Input_pos;
     }
 
-    /* check the end of string '\0' */
-    while (*Input_pos == '\0') {
-        /* try to restore input sources */
-        if (sp >= stack) {
-            Input_pos = *sp--;
-        }
+    /* check the end of string '\0', try to restore input sources */
+    while (*Input_pos == '\0' && sp >= stack) {
+        Input_pos = *sp--;
     }
 
     if (*Input_pos == '\0') {
@@ -166,9 +208,10 @@ static int advance()
         goto exit;
     }
 
-    /* check for macro, might be nested */
+    /* check for macro, might be nested. A '{' followed by a digit is a
+     * counted repetition instead. */
     if (!inquote) {
-        while (*Input_pos == '{') {
+        while (*Input_pos == '{' && !isdigit(Input_pos[1])) {
             *++sp = Input_pos; /* save current input source, will be
                                 * modified by expand_macro() */
             Input_pos = expand_macro(sp);
@@ -229,7 +272,7 @@ static int Num_states = 0;     /* number of states in NFA machine */
 static int Next_alloc = 0;     /* Index of next elements in the array */
 
 
-#define SSIZE 32                /* stack size */
+#define SSIZE MAX_NFA_STATES    /* stack size */
 static nfa_t *Sstack[SSIZE];           /* stack to save discarded pointer */
 static nfa_t **Sp = &Sstack[-1];       /* stack pointer */
 
@@ -241,9 +284,7 @@ static nfa_t **Sp = &Sstack[-1];       /* stack pointer */
 /* Allocate new NFA state */
 static nfa_t *new_state(void)
 {
-    static bool first_time = true;
-    if (first_time) {
-        first_time = false;
+    if (NFA_states == NULL) {
         NFA_states = (nfa_t *)calloc(MAX_NFA_STATES, sizeof(*NFA_states));
         if (NFA_states == NULL) {
             fprintf(stderr, "new_state: not enough memroy.\n");
@@ -274,18 +315,14 @@ static nfa_t *new_state(void)
 /* discard a NFA state */
 static void discard_state(nfa_t *state)
 {
-    /* note that the state might contain a bitset, we'll free it before push
-     * it to the stack
+    /* note that the bitset of the state is interned and shared, it is only
+     * freed by destory_thompson()
      * also, *state* might contain accept strings, they are saved in the pool
      * allocated by save(), if we discard an accepting state, the
      * corresponding part in the pool will leak(no way to fetch any more),
      * though we normally do not discard an accepting state */
     assert(state != NULL);
 
-    if (state->bitset != NULL) {
-        set_del(state->bitset);
-        state->bitset = NULL;
-    }
     int id = state->nfa_id;  /* recover ID */
     memset(state, 0, sizeof(*state));
     state->edge = EMPTY;
@@ -295,22 +332,40 @@ static void discard_state(nfa_t *state)
         exit(1);
     }
     PUSH(state);
+    Num_states--;
 }
 
-/* destory all the states in a machine */
+/* destory all the states in a machine, thompson() could be called again
+ * afterwards to build another machine. */
 void destory_thompson(void)
+{
+    int i;
+    for (i = 0; i < Nccls; i++) {
+        set_del(Ccls[i]);
+    }
+    table_free(Ccl_table, NULL);
+    Ccl_table = NULL;
+    Nccls = 0;
+    destory_thompson_states();
+}
+
+/* free the states of the machine but keep the classes, which the compact
+ * layout of nfa_table() shares. The start states of thompson_conds() and
+ * thompson_trails() are gone with them, so read their IDs before. */
+void destory_thompson_states(void)
 {
     free(NFA_states);
     NFA_states = NULL;
+    Num_states = 0;
+    Next_alloc = 0;
+    memset(Cond_start, 0, sizeof(Cond_start));
+    memset(Cond_bol, 0, sizeof(Cond_bol));
 }
 
-/* assign src to dst, dst's resources are freed. */
+/* assign src to dst, the bitset is shared. */
 static void assign_state(nfa_t **dst, const nfa_t *src)
 {
     int id = (*dst)->nfa_id;
-    if ((*dst)->bitset != NULL) {
-        set_del((*dst)->bitset);
-    }
 
     memcpy(*dst, src, sizeof(*src));
     (*dst)->nfa_id = id;
@@ -318,40 +373,88 @@ static void assign_state(nfa_t **dst, const nfa_t *src)
 
 /*---------------------------------------------------------------------------*/
 /* Just like what we do to NFA states, we'll save accepting strings in a large
- * pool of memory, also, we'll embed the line number of *str* into the saved
- * string, so that ((int*)(p->accept))[-1] is the line number. */
-const int MAX_SAVED_STRING = (10 * 1024);
-static char *save(char *str)
+ * pool of memory, also, we'll embed the line number and the rule number of
+ * *str* into the saved string, so that ACCEPT_LINE(p->accept) is the line
+ * number and ACCEPT_RULE(p->accept) is the rule number.
+ *
+ * The pool is a list of chunks, a new chunk is added when the current one is
+ * full, so a saved string never moves. The accepting strings of a DFA point
+ * into the pool, so the strings of earlier machines are kept; each machine
+ * starts a chunk of its own, and thompson_free_strings() frees the ones of
+ * the last machine when only the rule numbers of it are needed.
+ *
+ * Many rules share the same action, such as "return ID;". With
+ * %option shared-actions these are interned: the action is saved with the
+ * first rule having it, and the later rules take the same string. Thus
+ * equal actions are the same accepting string, so the DFA states accepting
+ * them could be merged by min_dfa(), but the rule number and line number of
+ * it are those of the first rule. That is why it is an option: the rule
+ * number no longer tells the rules apart. */
+#define STRING_CHUNK (10 * 1024)    /* size of a chunk, in bytes */
+#define MAX_ACTIONS 127             /* expected number of distinct actions */
+
+typedef struct chunk
+{
+    struct chunk *next;     /* chunk allocated before this */
+    int *avail;             /* next free position */
+    int *end;               /* end of the chunk */
+    int data[];
+} chunk_t;
+
+static chunk_t *Chunks = NULL;  /* the current chunk */
+static chunk_t *Kept = NULL;    /* the last chunk of the earlier machines */
+static hash_t *Actions = NULL;  /* interned actions of the current machine */
+
+static unsigned hash_str(const void *str);
+static int str_cmp(const void *a, const void *b);
+
+/* save *str*, do not intern it if not *share*. */
+static char *save(char *str, bool share)
 {
     assert(str != NULL);
 
-    static bool first_time = true;
-    static int *strings = NULL;
-    static int *savep = NULL; /* current position in string pool */
+    char *rval;
+    chunk_t *chunk;
+    int len = strlen(str) + 1;   /* count for the ending '\0' */
+    int nints = 2 + (len + sizeof(int) - 1) / sizeof(int);
+    int size;
+
+    if (share) {
+        if (Actions == NULL) {
+            Actions = hash_new(MAX_ACTIONS, hash_str, str_cmp);
+            if (Actions == NULL) {
+                fprintf(stderr, "save: not enough memory allocating action table\n");
+                exit(1);
+            }
+        }
+        if ((rval = (char *)hash_get(Actions, str)) != NULL) {
+            return rval;
+        }
+    }
 
-    if (first_time) {
-        /* allocate the string pool */
-        savep = strings = (int *)malloc(MAX_SAVED_STRING);
-        if (strings == NULL) {
+    if (Chunks == Kept || Chunks->avail + nints > Chunks->end) {
+        size = (nints * sizeof(int) > STRING_CHUNK) ? nints * sizeof(int) :
+                                                      STRING_CHUNK;
+        chunk = (chunk_t *)malloc(sizeof(*chunk) + size);
+        if (chunk == NULL) {
             fprintf(stderr, "save: not enough memory allocating string pool\n");
             exit(1);
         }
-        first_time = false;
+        chunk->next = Chunks;
+        chunk->avail = chunk->data;
+        chunk->end = chunk->data + size / sizeof(int);
+        Chunks = chunk;
     }
 
-    *savep++ = 0;   /* save the line number, TODO: involve the actual line
-                       number */
+    Chunks->avail[0] = Rule_num;
+    Chunks->avail[1] = Lineno;
+    rval = (char *)(Chunks->avail + 2);
+    strcpy(rval, str);
+    Chunks->avail += nints;
 
-    int len = strlen(str);
-    if ((char*)savep+len+1 >= (char*)strings+MAX_SAVED_STRING) {
-        fprintf(stderr, "save: max size of pool exceeded.\n");
-        exit(1);
+    if (share) {
+        hash_add(Actions, rval, rval);
     }
-    strcpy((char*)savep, str);
-    char *rval = (char*)savep;
-    len += 2;  /* count for the ending '\0' of *str* and move past it */
-    savep += (len/sizeof(int)) + ((len % sizeof(int) == 0 ? 0 : 1));
-
     return rval;
 }
 
@@ -366,73 +469,469 @@ static char *save(char *str)
 /* construct NFA machine. return the state array. */
 nfa_t *thompson(char *(*input_func)(void), nfa_t **start, int *max_state)
 {
-    nfa_t *rval = NULL;
+    int c;
+
     Input_func = input_func;
     Current_tok = EOS;  /* load the first token */
+    Rule_num = 0;
+    Lineno = 0;
+    table_free(Actions, NULL);  /* strings of the last machine are kept */
+    Actions = NULL;
+    Kept = Chunks;
+
+    for (c = 1; c < Nconds; c++) {
+        free(Cond_names[c]);
+    }
+    Nconds = 1;
+    Inclusive = 1;
+    Caseless = false;
+    Shared = false;
+    memset(Cond_start, 0, sizeof(Cond_start));
+    memset(Cond_bol, 0, sizeof(Cond_bol));
+    Ntrails = 0;
+
     advance();
+    machine();
+    compact();
+    *start = Cond_bol[0];
     *max_state = Next_alloc;
-    *start = machine();
     return NFA_states;
 }
 
+/* free the accepting strings of the machine built by the last thompson() */
+void thompson_free_strings(void)
+{
+    chunk_t *next;
+
+    table_free(Actions, NULL);
+    Actions = NULL;
+    while (Chunks != Kept) {
+        next = Chunks->next;
+        free(Chunks);
+        Chunks = next;
+    }
+}
+
+/* start conditions of the machine built by the last thompson() */
+int thompson_conds(nfa_t ***starts, nfa_t ***bol_starts, char ***names)
+{
+    if (starts != NULL) {
+        *starts = Cond_start;
+    }
+    if (bol_starts != NULL) {
+        *bol_starts = Cond_bol;
+    }
+    if (names != NULL) {
+        *names = Cond_names;
+    }
+    return Nconds;
+}
+
+/* rules with trailing context of the machine built by the last thompson() */
+int thompson_trails(trail_t **trails)
+{
+    *trails = Trails;
+    return Ntrails;
+}
+
+/* the character classes of the machine built by the last thompson() */
+int thompson_ccls(set_t ***ccls)
+{
+    *ccls = Ccls;
+    return Nccls;
+}
+
 static nfa_t *machine()
 {
     ENTER("machine");
-    /* machine  ::= ( rule )+ END_OF_INPUT 
-     * A machine should have at least one rule. */
-    nfa_t *start = NULL;
-    nfa_t *p = NULL;
-
-    p = start = new_state(); /* remember that new state's edge is EPSILON */
-    p->next1 = rule();
+    /* machine  ::= ( declaration )* ( rule )+ END_OF_INPUT
+     * A machine is a OR of several rules, one for each start condition: the
+     * start state of a condition is the root of a balanced tree of EPSILON
+     * states whose leaves are the rules active in the condition, so the
+     * closure of the start state goes O(log n) deep instead of walking a
+     * chain of n states. The rules themselves are built only once and shared
+     * by the conditions.
+     *
+     * Rules starting with the same literal characters are merged into a trie
+     * first(see merge_prefix()), only the rules active in the same
+     * conditions are merged, so every condition still sees its own rules.
+     *
+     * Rules anchored by ^ are only in a second tree of the condition, used at
+     * the beginning of a line, which goes on with the first tree. So ^ costs
+     * no state in the rule itself.
+     *
+     * Neither the shape of the trees nor the trie changes the priority of
+     * the rules, as it only depends on the accepting states. */
+    nfa_t **starts = NULL;  /* start state of every rule */
+    unsigned *conds = NULL; /* conditions every rule is active in */
+    bool *bol = NULL;       /* true if the rule is anchored by ^ */
+    nfa_t **list;
+    int *indegree;
+    bool *done;             /* the rule has been merged with the others */
+    int nrules = 0;
+    int size = 0;
+    anchor_t anchor;
+    int c, i, j, k, n;
 
     while(!match(END_OF_INPUT)) {
-        /* a machine is a OR of several rules */
-        p->next2 = new_state();
-        p = p->next2;
-        p->next1 = rule();
+        if (declaration()) {
+            continue;
+        }
+
+        if (nrules >= size) {
+            size = size ? size * 2 : 64;
+            starts = (nfa_t **)realloc(starts, size * sizeof(*starts));
+            conds = (unsigned *)realloc(conds, size * sizeof(*conds));
+            bol = (bool *)realloc(bol, size * sizeof(*bol));
+            if (starts == NULL || conds == NULL || bol == NULL) {
+                fprintf(stderr, "machine: not enough memory\n");
+                exit(1);
+            }
+        }
+        starts[nrules] = rule(&conds[nrules], &anchor);
+        bol[nrules] = (anchor & START) != 0;
+        nrules++;
     }
 
+    /* the number of edges entering each state */
+    indegree = (int *)calloc(Next_alloc, sizeof(int));
+    list = (nfa_t **)malloc((nrules + 1) * sizeof(nfa_t *));
+    done = (bool *)calloc(nrules + 1, sizeof(bool));
+    if (indegree == NULL || list == NULL || done == NULL) {
+        fprintf(stderr, "machine: not enough memory\n");
+        exit(1);
+    }
+    for (i = 0; i < Next_alloc; i++) {
+        if (NFA_states[i].next1 != NULL) {
+            indegree[NFA_states[i].next1->nfa_id]++;
+        }
+        if (NFA_states[i].next2 != NULL) {
+            indegree[NFA_states[i].next2->nfa_id]++;
+        }
+    }
+
+    /* merge the prefixes of the rules of the same conditions, the roots of
+     * the trie are left in place of the first rules, NULL in the others */
+    for (i = 0; i < nrules; i++) {
+        if (done[i]) {
+            continue;
+        }
+        for (n = 0, j = i; j < nrules; j++) {
+            if (conds[j] == conds[i] && bol[j] == bol[i]) {
+                list[n++] = starts[j];
+                done[j] = true;
+            }
+        }
+        n = merge_prefix(list, n, indegree, 0);
+        for (k = 0, j = i; j < nrules; j++) {
+            if (conds[j] == conds[i] && bol[j] == bol[i]) {
+                starts[j] = k < n ? list[k++] : NULL;
+            }
+        }
+    }
+
+    for (c = 0; c < Nconds; c++) {
+        for (n = 0, i = 0; i < nrules; i++) {
+            if (starts[i] != NULL && (conds[i] & (1u << c)) && !bol[i]) {
+                list[n++] = starts[i];
+            }
+        }
+        if (n < 2) {    /* a condition starts in a state of its own */
+            list[n++] = new_state();
+        }
+        Cond_start[c] = alternate(list, n);
+
+        for (n = 0, i = 0; i < nrules; i++) {
+            if (starts[i] != NULL && (conds[i] & (1u << c)) && bol[i]) {
+                list[n++] = starts[i];
+            }
+        }
+        if (n == 0) {
+            Cond_bol[c] = Cond_start[c];
+        } else {
+            Cond_bol[c] = new_state();
+            Cond_bol[c]->next1 = alternate(list, n);
+            Cond_bol[c]->next2 = Cond_start[c];
+        }
+    }
+
+    free(starts);
+    free(conds);
+    free(bol);
+    free(indegree);
+    free(list);
+    free(done);
+
     LEAVE("machine");
-    return start;
+    return Cond_bol[0];     /* the input starts at the beginning of a line */
 }
 
-static nfa_t *rule(void)
+#define NCHARS 256      /* characters merged by merge_prefix() */
+
+/* Merge the fragments in *list* that start with the same literal character
+ * into a trie: the first state of the first one is kept, its next state
+ * becomes an alternation of what follows the character in every fragment,
+ * and those are merged the same way. Only states entered by *in* edges are
+ * merged(0 for the rules, 1 for what follows a merged state), a state
+ * entered from elsewhere, e.g. by a loop, is left alone. The merged away
+ * states are discarded. The fragments left are moved to the front of *list*,
+ * return the number of them. */
+static int merge_prefix(nfa_t **list, int n, const int *indegree, int in)
+{
+    static int last[2][NCHARS];  /* last fragment starting with a character,
+                                  * by the fold flag */
+    int *chain;     /* next fragment starting with the same character */
+    bool *head;     /* the first fragment starting with its character */
+    nfa_t **next;   /* the fragments following a character */
+    nfa_t *p;
+    int m = 0;
+    int i, j, k;
+
+#define MERGEABLE(p) ((p)->edge >= 0 && (p)->edge < NCHARS && \
+                      (p)->accept == NULL && indegree[(p)->nfa_id] == in)
+#define LAST(p) last[(p)->fold][(p)->edge]
+
+    chain = (int *)malloc(n * sizeof(*chain));
+    head = (bool *)malloc(n * sizeof(*head));
+    next = (nfa_t **)malloc(n * sizeof(*next));
+    if (chain == NULL || head == NULL || next == NULL) {
+        fprintf(stderr, "merge_prefix: not enough memory\n");
+        exit(1);
+    }
+
+    for (i = 0; i < n; i++) {
+        chain[i] = -1;
+        head[i] = false;
+        if (MERGEABLE(list[i])) {
+            LAST(list[i]) = -1;
+        }
+    }
+    for (i = 0; i < n; i++) {
+        if (!MERGEABLE(list[i])) {
+            continue;
+        }
+        if (LAST(list[i]) < 0) {
+            head[i] = true;
+        } else {
+            chain[LAST(list[i])] = i;
+        }
+        LAST(list[i]) = i;
+    }
+
+    for (i = 0; i < n; i++) {
+        if (!head[i] || chain[i] < 0) {
+            continue;
+        }
+        p = list[i];
+        k = 0;
+        next[k++] = follow(p, indegree, true);
+        for (j = chain[i]; j >= 0; j = chain[j]) {
+            next[k++] = follow(list[j], indegree, true);
+            discard_state(list[j]);
+            list[j] = NULL;
+        }
+        k = merge_prefix(next, k, indegree, 1);
+        p->next1 = alternate(next, k);
+    }
+
+    for (i = 0; i < n; i++) {
+        if (list[i] != NULL) {
+            list[m++] = list[i];
+        }
+    }
+
+#undef LAST
+#undef MERGEABLE
+
+    free(chain);
+    free(head);
+    free(next);
+    return m;
+}
+
+/* return the state following the character of *p*, skipping the EPSILON
+ * states that only link it to the next one. If *discard*, those states are
+ * discarded. */
+static nfa_t *follow(nfa_t *p, const int *indegree, bool discard)
+{
+    nfa_t *link = p->next1;
+    nfa_t *next;
+
+    while (link->edge == EPSILON && link->next1 != NULL &&
+           link->next2 == NULL && link->accept == NULL &&
+           indegree[link->nfa_id] == 1) {
+        next = link->next1;
+        if (discard) {
+            discard_state(link);
+        }
+        link = next;
+    }
+    return link;
+}
+
+/* return the root of a balanced tree of EPSILON states whose leaves are the
+ * *n* states of *list*, the state itself if n is 1 */
+static nfa_t *alternate(nfa_t **list, int n)
+{
+    nfa_t *p;
+
+    if (n == 1) {
+        return list[0];
+    }
+    p = new_state();
+    p->next1 = alternate(list, n / 2);
+    p->next2 = alternate(list + n / 2, n - n / 2);
+    return p;
+}
+
+static bool declaration(void)
+{
+    /* declaration ::= %s names     ; inclusive start conditions
+     *               | %x names     ; exclusive start conditions
+     *               | %option names
+     * Rules without a prefix are active in INITIAL and the inclusive
+     * conditions, so the conditions are declared before the rules. */
+    bool exclusive;
+    char *p;
+    int len;
+
+    if (match(L) && Lexeme == '%' && strncmp(Input_pos, "option", 6) == 0 &&
+        isspace(Input_pos[6])) {
+        option(Input_pos + 6);
+        return true;
+    }
+    if (!match(L) || Lexeme != '%' || (*Input_pos != 's' &&
+        *Input_pos != 'x') || !isspace(Input_pos[1])) {
+        return false;
+    }
+    if (Rule_num > 0) {
+        fprintf(stderr, "declaration: start conditions should be declared "
+                "before the rules\n");
+        exit(1);
+    }
+
+    exclusive = (*Input_pos == 'x');
+    for (p = Input_pos + 1; ; p += len) {
+        while (isspace(*p)) {
+            p++;
+        }
+        if (*p == '\0') {
+            break;
+        }
+        for (len = 0; p[len] != '\0' && !isspace(p[len]); len++) {
+            /* pass */
+        }
+
+        if (Nconds >= MAX_CONDS) {
+            fprintf(stderr, "declaration: too many start conditions\n");
+            exit(1);
+        }
+        if (find_cond(p, len) >= 0) {
+            fprintf(stderr, "declaration: start condition %.*s redeclared\n",
+                    len, p);
+            exit(1);
+        }
+        Cond_names[Nconds] = strndup(p, len);
+        if (Cond_names[Nconds] == NULL) {
+            fprintf(stderr, "declaration: not enough memory\n");
+            exit(1);
+        }
+        if (!exclusive) {
+            Inclusive |= 1u << Nconds;
+        }
+        Nconds++;
+    }
+
+    Input_pos = p;
+    Current_tok = EOS;
+    advance();  /* the first token of the next line */
+    return true;
+}
+
+/* Parse the names of %option, *p* is right after "%option". Options apply
+ * to the rules after them:
+ *   case-insensitive(or caseless)  letters match either case
+ *   case-sensitive                 letters match themselves only */
+static void option(char *p)
+{
+    int len;
+
+    for (; ; p += len) {
+        while (isspace(*p)) {
+            p++;
+        }
+        if (*p == '\0') {
+            break;
+        }
+        for (len = 0; p[len] != '\0' && !isspace(p[len]); len++) {
+            /* pass */
+        }
+
+        if ((len == 16 && strncmp(p, "case-insensitive", len) == 0) ||
+            (len == 8 && strncmp(p, "caseless", len) == 0)) {
+            Caseless = true;
+        } else if (len == 14 && strncmp(p, "case-sensitive", len) == 0) {
+            Caseless = false;
+        } else if (len == 14 && strncmp(p, "shared-actions", len) == 0) {
+            Shared = true;
+        } else if (len == 17 && strncmp(p, "no-shared-actions", len) == 0) {
+            Shared = false;
+        } else {
+            fprintf(stderr, "option: unknown option %.*s\n", len, p);
+            exit(1);
+        }
+    }
+
+    Input_pos = p;
+    Current_tok = EOS;
+    advance();  /* the first token of the next line */
+}
+
+static nfa_t *rule(unsigned *conds, anchor_t *anchor)
 {
     ENTER("rule");
-    /* rule     ::=  expr  EOS action
-                  | ^expr  EOS action
-                  |  expr$ EOS action */
+    /* rule     ::= conds  expr  EOS action
+                  | conds ^expr  EOS action
+                  | conds  expr$ EOS action
+                  | conds  expr/expr EOS action
+       conds    ::= <name(,name)*> | <*> | epsilon
+     * *conds* is set to the conditions the rule is active in and *anchor*
+     * to its anchor. Anchors are zero width context, they add no state to
+     * the rule: ^ is handled by machine() and $ by the accepting state,
+     * which only accepts when the next character is a newline. r/s matches
+     * r followed by s, s is only the trailing context, see trail(). */
     nfa_t *start = NULL;
     nfa_t *end = NULL;
-    anchor_t anchor = NONE;
+    nfa_t *head_end = NULL;
+    nfa_t *tail_start = NULL;
+
+    if (!cond_prefix(conds)) {
+        *conds = Inclusive;
+    }
+    Fold = Caseless;
 
+    *anchor = NONE;
     if (match(AT_BOL)) {
-        start = new_state();
-        start->edge = '\n';
-        anchor = START;
+        *anchor = START;
         advance();
-        expr(&start->next1, &end);
-    } else {
-        expr(&start, &end);
     }
+    expr(&start, &end);
 
-    if (match(AT_EOL)) {
-        /* pattern followed by a \r or \n, use a character class */
+    if (match(TRAIL)) {
         advance();
+        head_end = end;
+        expr(&tail_start, &end);
+        head_end->next1 = tail_start;
+    }
 
-        end->next1 = new_state();
-        end->edge = CCL;
-        end->bitset = set_new();
-        if (end->bitset == NULL) {
-            fprintf(stderr, "rule(): not enough memory allocating character class\n");
+    if (match(AT_EOL)) {
+        /* TODO: if not in *NIX, '\r' should be a newline as well */
+        if (tail_start != NULL) {
+            fprintf(stderr, "rule: $ after trailing context\n");
             exit(1);
         }
-        set_add(end->bitset, '\n');
-
-        /* TODO: if not in *NIX, add '\r' as well */
-        end = end->next1;
-        anchor |= END;
+        advance();
+        *anchor |= END;
     }
 
     if (!match(EOS)) {
@@ -444,14 +943,76 @@ static nfa_t *rule(void)
         Input_pos ++;
     }
 
-    end->accept = save(Input_pos);
-    end->anchor = anchor;
+    /* trail records are found by the accepting string, so a rule with
+     * trailing context has one of its own */
+    end->accept = save(Input_pos, Shared && tail_start == NULL);
+    end->anchor = *anchor;
+    if (tail_start != NULL) {
+        trail(start, head_end, tail_start, end, end->accept);
+    }
+    Rule_num++;
 
     advance();  /* skip the EOS token */
     LEAVE("rule");
     return start;
 }
 
+/* Parse the condition prefix <name,...> of a rule, '*' stands for all the
+ * conditions. Return false if the rule has no such prefix, a '<' followed by
+ * anything but declared names is an ordinary character. */
+static bool cond_prefix(unsigned *conds)
+{
+    char *p = Input_pos;    /* right after the '<' */
+    unsigned mask = 0;
+    int len;
+    int c;
+
+    if (!match(L) || Lexeme != '<') {
+        return false;
+    }
+
+    for (;;) {
+        for (len = 0; isalnum(p[len]) || p[len] == '_' || p[len] == '*';
+             len++) {
+            /* pass */
+        }
+        if (len == 1 && *p == '*') {
+            mask |= ALL_CONDS;
+        } else if ((c = find_cond(p, len)) >= 0) {
+            mask |= 1u << c;
+        } else {
+            return false;
+        }
+
+        p += len;
+        if (*p == '>') {
+            break;
+        } else if (*p != ',') {
+            return false;
+        }
+        p++;
+    }
+
+    Input_pos = p + 1;
+    advance();
+    *conds = mask;
+    return true;
+}
+
+/* return the number of the condition named by name[0 ... len-1], -1 if none */
+static int find_cond(const char *name, int len)
+{
+    int c;
+
+    for (c = 0; c < Nconds; c++) {
+        if (strncmp(Cond_names[c], name, len) == 0 &&
+            Cond_names[c][len] == '\0') {
+            return c;
+        }
+    }
+    return -1;
+}
+
 static void expr(nfa_t **start, nfa_t **end)
 {
     ENTER("expr");
@@ -540,7 +1101,8 @@ static bool first_in_cat(enum token t)
 static void factor(nfa_t **start, nfa_t **end)
 {
     ENTER("factor");
-    /* factor   ::= term* | term+ | term? | term
+    /* factor   ::= term* | term+ | term? | term{n} | term{n,} | term{n,m}
+     *            | term
      *        +---------+
      * o -->  |o  -->  o| --> o
      *        +---------+
@@ -548,9 +1110,13 @@ static void factor(nfa_t **start, nfa_t **end)
      */
     nfa_t *new_start = NULL;
     nfa_t *new_end = NULL;
+    int before = Num_states;
 
     term(start, end);
-    if (match(CLOSURE) || match(PLUS_CLOSE) || match(OPTIONAL)) {
+    if (match(CURLY_OPEN)) {
+        repeat(start, end, Num_states - before);
+        advance();
+    } else if (match(CLOSURE) || match(PLUS_CLOSE) || match(OPTIONAL)) {
         new_start = new_state();
         new_end = new_state();
         new_start->next1 = *start;
@@ -570,15 +1136,109 @@ static void factor(nfa_t **start, nfa_t **end)
     LEAVE("factor");
 }
 
+#define MAX_REPEAT_STATES 256   /* warn if a counted repetition makes more
+                                 * NFA states than this */
+
+/* Turn the term from *start* to *end* into the counted repetition right
+ * after it, Input_pos is at the first digit. *size* is the number of states
+ * of the term. The term is copied, not parsed again:
+ *
+ *     a{2,4}  ==>  a a (a (a)?)?      a{2,}  ==>  a a+
+ *
+ * every optional copy is entered by a branch state that could also go
+ * straight to the end, so each one only costs a state more than the term. */
+static void repeat(nfa_t **start, nfa_t **end, int size)
+{
+    nfa_t *term_start = *start;
+    nfa_t *term_end = *end;
+    nfa_t *piece_start;     /* the copy of the term being added */
+    nfa_t *piece_end;
+    nfa_t *last = NULL;     /* end of the copies added so far */
+    nfa_t *final;
+    nfa_t *p;
+    char *endp;
+    int min;
+    int max;                /* -1 if there is no upper bound */
+    int count;              /* number of copies, including the term */
+    int i;
+
+    min = max = strtol(Input_pos, &endp, 10);
+    if (*endp == ',') {
+        endp++;
+        max = isdigit(*endp) ? strtol(endp, &endp, 10) : -1;
+    }
+    if (*endp != '}' || (max != -1 && (max < min || max == 0))) {
+        fprintf(stderr, "repeat: bad counted repetition on line %d\n",
+                Lineno);
+        exit(1);
+    }
+    Input_pos = endp + 1;
+
+    count = (max != -1) ? max : (min > 0) ? min : 1;
+    if (Num_states + size * count + count >= MAX_NFA_STATES) {
+        fprintf(stderr, "repeat: the counted repetition on line %d needs "
+                "too many states, consider {%d,} and checking the length in "
+                "the action\n", Lineno, min);
+        exit(1);
+    } else if (size * count > MAX_REPEAT_STATES) {
+        fprintf(stderr, "repeat: warning: the counted repetition on line %d "
+                "makes %d NFA states, the DFA might be large, consider "
+                "{%d,} and checking the length in the action\n", Lineno,
+                size * count, min);
+    }
+
+    final = new_state();
+    for (i = 0; i < count; i++) {
+        if (i == 0) {
+            piece_start = term_start;
+            piece_end = term_end;
+        } else {
+            copy(term_start, term_end, &piece_start, &piece_end, false);
+        }
+        p = piece_start;
+
+        if (max == -1 && i == count - 1) {
+            piece_end->next2 = piece_start;     /* the last one loops */
+        }
+        if (i >= min) {     /* optional, could skip to the end */
+            p = new_state();
+            p->next1 = piece_start;
+            p->next2 = final;
+        }
+
+        if (last == NULL) {
+            *start = p;
+        } else {
+            last->next1 = p;
+        }
+        last = piece_end;
+    }
+    last->next1 = final;
+    *end = final;
+}
+
 static void term(nfa_t **start, nfa_t **end)
 {
     ENTER("term");
     /* term     ::= [string] | [^string] | [] | [^] | . | (expr) | <character>
-     */
+     *            | (?i:expr) | (?-i:expr)
+     * Case-insensitive terms cost no extra state or edge: a letter is kept
+     * folded in the label, and so is a character class, and the state is
+     * marked to fold the input before matching(see move() in terp.c). */
     if (match(PAREN_OPEN)) {
+        bool fold = Fold;
+
+        if (strncmp(Input_pos, "?i:", 3) == 0) {
+            Fold = true;
+            Input_pos += 3;
+        } else if (strncmp(Input_pos, "?-i:", 4) == 0) {
+            Fold = false;
+            Input_pos += 4;
+        }
         advance();
         expr(start, end);
         if (match(PAREN_CLOSE)) {
+            Fold = fold;
             advance();
         } else {
             fprintf(stderr, "term: missing parentheses\n");
@@ -614,9 +1274,15 @@ static void term(nfa_t **start, nfa_t **end)
                 fprintf(stderr, "term: ] not matched.\n");
             }
 
+            if (Fold) {
+                fold_set(new_start->bitset);
+                new_start->fold = true;
+            }
             if (negtive) {
                 set_invert(new_start->bitset);
             }
+            new_start->ccl = intern_ccl(new_start->bitset);
+            new_start->bitset = Ccls[new_start->ccl];
 
         } else if (match(ANY)) {
             new_start->edge = CCL;
@@ -630,9 +1296,12 @@ static void term(nfa_t **start, nfa_t **end)
             set_add(new_start->bitset, '\n');
             /* TODO: if not in UNIX, add '\r' as well */
             set_invert(new_start->bitset);
+            new_start->ccl = intern_ccl(new_start->bitset);
+            new_start->bitset = Ccls[new_start->ccl];
             advance();
         } else {
-            new_start->edge = Lexeme;
+            new_start->edge = Fold ? FOLD(Lexeme) : Lexeme;
+            new_start->fold = Fold;
             advance();
         }
     }
@@ -669,6 +1338,483 @@ static void dodash(set_t *set)
     }
 }
 
+/* fold the members of a case-insensitive character class: a letter in either
+ * case becomes the lower case one. It is done before a [^string] is inverted,
+ * so the class leaves out both cases of its letters. */
+static void fold_set(set_t *set)
+{
+    int c;
+
+    for (c = 'A'; c <= 'Z'; c++) {
+        if (set_is_member(set, c)) {
+            set_remove(set, c);
+            set_add(set, FOLD(c));
+        }
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+/* Character classes
+ *
+ * The same class is often written in many rules, or comes from a macro
+ * expanded many times. Every class is interned when its term is parsed: the
+ * first set of a content is kept in a table keyed by the content and gets
+ * an ID, the sets built later with the same content are freed and the state
+ * shares the first one. So every distinct class is stored once, and two
+ * classes are the same exactly when their IDs are. */
+#define MAX_CCLS 127    /* expected number of classes, the table grows its
+                         * chains beyond it */
+
+/* hash of the members of a set, trailing empty words are not counted as
+ * set_is_equal() ignores them */
+static unsigned hash_set(const void *p)
+{
+    const set_t *set = (const set_t *)p;
+    unsigned h = 5381;
+    int n = set->nwords;
+    int i;
+
+    while (n > 0 && set->map[n-1] == 0) {
+        n--;
+    }
+    for (i = 0; i < n; i++) {
+        h = h * 33 + set->map[i];
+    }
+    return h;
+}
+
+static int set_cmp(const void *a, const void *b)
+{
+    return set_is_equal((set_t *)a, (set_t *)b) ? 0 : 1;
+}
+
+/* intern *set*, return the ID of the class. *set* is freed if the class is
+ * already there. */
+static int intern_ccl(set_t *set)
+{
+    intptr_t id;
+
+    if (Ccl_table == NULL) {
+        Ccl_table = hash_new(MAX_CCLS, hash_set, set_cmp);
+        if (Ccl_table == NULL) {
+            fprintf(stderr, "intern_ccl: not enough memory allocating class table\n");
+            exit(1);
+        }
+    }
+    if ((id = (intptr_t)hash_get(Ccl_table, set)) != 0) {
+        set_del(set);
+        return id - 1;
+    }
+
+    if (Nccls >= Ccls_size) {
+        Ccls_size = Ccls_size ? Ccls_size * 2 : 16;
+        Ccls = (set_t **)realloc(Ccls, Ccls_size * sizeof(*Ccls));
+        if (Ccls == NULL) {
+            fprintf(stderr, "intern_ccl: not enough memory\n");
+            exit(1);
+        }
+    }
+    Ccls[Nccls] = set;
+    hash_add(Ccl_table, set, (void *)(intptr_t)(Nccls + 1));    /* ID + 1, not NULL */
+    return Nccls++;
+}
+
+/*---------------------------------------------------------------------------*/
+/* Compaction
+ *
+ * The construction leaves a lot of EPSILON states that only link a fragment
+ * to the next one: every concatenation, closure and rule adds some, and
+ * states discarded while merging prefixes are left behind. They make the
+ * sets of the subset construction larger and the closures deeper.
+ *
+ * Every edge that goes into such a link(an EPSILON state with a single edge
+ * that does not accept) is redirected to the state the link goes to. The
+ * states no longer reachable from the start states are removed, and the
+ * rest is moved to the front of the array, keeping the order of their IDs.
+ * The priority of the rules only depends on the order of the accepting
+ * states, so it does not change.
+ *
+ * Only the EPSILON states with two edges are left, they could not go away
+ * as a state has only one edge that reads a character. The start states are
+ * kept even if they are links: every condition starts in a state of its
+ * own. */
+#define LINK(p) ((p)->edge == EPSILON && (p)->next1 != NULL && \
+                 (p)->next2 == NULL && (p)->accept == NULL)
+
+static void compact(void)
+{
+    int *pos;       /* new position of every state, -1 if removed */
+    nfa_t **stack;
+    nfa_t *p;
+    int top = 0;
+    int n = 0;
+    int i, c;
+
+    pos = (int *)malloc(Next_alloc * sizeof(int));
+    stack = (nfa_t **)malloc(Next_alloc * sizeof(nfa_t *));
+    if (pos == NULL || stack == NULL) {
+        fprintf(stderr, "compact: not enough memory\n");
+        exit(1);
+    }
+
+    for (i = 0; i < Next_alloc; i++) {
+        NFA_states[i].next1 = skip_links(NFA_states[i].next1);
+        NFA_states[i].next2 = skip_links(NFA_states[i].next2);
+        pos[i] = -1;
+    }
+
+#define REACH(p) do {                                   \
+        if ((p) != NULL && pos[(p)->nfa_id] < 0) {      \
+            pos[(p)->nfa_id] = 0;                       \
+            stack[top++] = (p);                         \
+        }                                               \
+    } while (0)
+
+    for (c = 0; c < Nconds; c++) {
+        REACH(Cond_start[c]);
+        REACH(Cond_bol[c]);
+    }
+    for (i = 0; i < Ntrails; i++) {
+        REACH(Trails[i].head_start);
+        REACH(Trails[i].tail_start);
+    }
+    while (top > 0) {
+        p = stack[--top];
+        REACH(p->next1);
+        REACH(p->next2);
+    }
+
+#undef REACH
+
+    for (i = 0; i < Next_alloc; i++) {
+        if (pos[i] == 0) {
+            pos[i] = n++;
+        }
+    }
+
+    /* the new position is never behind the old one */
+    for (i = 0; i < Next_alloc; i++) {
+        if (pos[i] >= 0 && pos[i] != i) {
+            NFA_states[pos[i]] = NFA_states[i];
+        }
+    }
+
+#define MOVE(p) ((p) = (p) ? &NFA_states[pos[(p) - NFA_states]] : NULL)
+
+    for (i = 0; i < n; i++) {
+        MOVE(NFA_states[i].next1);
+        MOVE(NFA_states[i].next2);
+        NFA_states[i].nfa_id = i;
+    }
+    for (c = 0; c < Nconds; c++) {
+        MOVE(Cond_start[c]);
+        MOVE(Cond_bol[c]);
+    }
+    for (i = 0; i < Ntrails; i++) {
+        MOVE(Trails[i].head_start);
+        MOVE(Trails[i].tail_start);
+    }
+
+#undef MOVE
+
+    for (i = n; i < Next_alloc; i++) {
+        memset(&NFA_states[i], 0, sizeof(NFA_states[i]));
+        NFA_states[i].nfa_id = i;
+    }
+    Next_alloc = Num_states = n;
+    Sp = &Sstack[-1];   /* the discarded states are gone as well */
+
+    free(pos);
+    free(stack);
+}
+
+/* return the state *p* leads to after the links */
+static nfa_t *skip_links(nfa_t *p)
+{
+    int n;
+
+    for (n = 0; p != NULL && LINK(p) && n < Next_alloc; n++) {
+        p = p->next1;
+    }
+    return p;
+}
+
+#undef LINK
+
+/*---------------------------------------------------------------------------*/
+/* Compact layout
+ *
+ * A nfa_t takes two pointers, a set, the class ID, an accepting string, an
+ * anchor, the fold flag and an ID: 56 bytes on a 64-bit machine. The parser
+ * needs the pointers to build the machine, the simulation does not. So a
+ * finished machine is turned into an array for each field: the label, two
+ * 32-bit next states and one byte of flags, 13 bytes a state, and then the
+ * states could be freed by destory_thompson_states(). A class label is the
+ * ID of the interned class, the table shares the pool of them rather than
+ * copying it, so it must be deleted before destory_thompson(). The few
+ * accepting states go to a table of their own. */
+nfa_table_t *nfa_table(const nfa_t *states, int nstates)
+{
+    nfa_table_t *table;
+    const nfa_t *p;
+    int i;
+
+    table = (nfa_table_t *)calloc(1, sizeof(*table));
+    if (table == NULL) {
+        fprintf(stderr, "nfa_table: not enough memory\n");
+        exit(1);
+    }
+    table->nstates = nstates;
+    table->label = (int32_t *)malloc(nstates * (3 * sizeof(int32_t) +
+                                                sizeof(uint8_t)));
+    table->nccls = Nccls;
+    table->ccls = Ccls;
+    table->accept_state = (int32_t *)malloc(nstates * sizeof(int32_t));
+    table->accept = (char **)malloc(nstates * sizeof(char *));
+    table->anchor = (anchor_t *)malloc(nstates * sizeof(anchor_t));
+    if (table->label == NULL ||
+        table->accept_state == NULL || table->accept == NULL ||
+        table->anchor == NULL) {
+        fprintf(stderr, "nfa_table: not enough memory\n");
+        exit(1);
+    }
+    table->next1 = table->label + nstates;
+    table->next2 = table->next1 + nstates;
+    table->flags = (uint8_t *)(table->next2 + nstates);
+
+    for (i = 0; i < nstates; i++) {
+        p = &states[i];
+        table->label[i] = p->edge;
+        table->next1[i] = p->next1 ? p->next1->nfa_id : -1;
+        table->next2[i] = p->next2 ? p->next2->nfa_id : -1;
+        table->flags[i] = p->fold ? NFA_FOLD : 0;
+
+        if (p->edge == CCL) {
+            table->label[i] = CCL_LABEL(p->ccl);
+        }
+        if (p->accept != NULL) {
+            table->flags[i] |= NFA_ACCEPT;
+            table->accept_state[table->naccepts] = i;
+            table->accept[table->naccepts] = p->accept;
+            table->anchor[table->naccepts] = p->anchor;
+            table->naccepts++;
+        }
+    }
+
+    return table;
+}
+
+/* destory the compact layout */
+void nfa_table_del(nfa_table_t *table)
+{
+    if (table == NULL) {
+        return;
+    }
+    free(table->label);
+    free(table->accept_state);
+    free(table->accept);
+    free(table->anchor);
+    free(table);
+}
+
+/* index of *state* in the accepting states, found by a binary search */
+int nfa_table_accept(const nfa_table_t *table, int state)
+{
+    int lo = 0;
+    int hi = table->naccepts;
+    int mid;
+
+    if (!(table->flags[state] & NFA_ACCEPT)) {
+        return -1;
+    }
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (table->accept_state[mid] < state) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/*---------------------------------------------------------------------------*/
+/* Trailing context
+ *
+ * The rule r/s is built as rs, the split between r and s is found when the
+ * token is accepted. Mostly r or s matches strings of a single length only
+ * (e.g. "if/\(" or "[0-9]+/\.\."), then the split is a constant offset from
+ * the start or the end of the match, and nothing is scanned again.
+ *
+ * Otherwise the NFA gets two more fragments that are not reachable from the
+ * rules: a copy of r, which accepts on its own, and a copy of s reversed.
+ * They get start states of their own in the DFA, the scanner runs the first
+ * one forward over the match to find where r could end, and the second one
+ * backward from the end to find where s could start. The last position that
+ * is both is the split. */
+
+/* record the trailing context of the rule being parsed, r is the fragment
+ * from *start* to *end* and s the one from *tail_start* to *tail_end*. The
+ * copies accept *accept*, the accepting string of the rule. */
+static void trail(nfa_t *start, nfa_t *end, nfa_t *tail_start,
+                  nfa_t *tail_end, char *accept)
+{
+    trail_t *t;
+    nfa_t *copy_end;
+
+    if (Ntrails >= Trails_size) {
+        Trails_size = Trails_size ? Trails_size * 2 : 8;
+        Trails = (trail_t *)realloc(Trails, Trails_size * sizeof(*Trails));
+        if (Trails == NULL) {
+            fprintf(stderr, "trail: not enough memory\n");
+            exit(1);
+        }
+    }
+
+    t = &Trails[Ntrails++];
+    t->rule = Rule_num;
+    t->head = fixed_len(start, end);
+    t->tail = fixed_len(tail_start, tail_end);
+    t->head_start = t->tail_start = NULL;
+
+    if (t->head < 0 && t->tail < 0) {
+        copy(start, end, &t->head_start, &copy_end, false);
+        copy_end->accept = accept;
+        copy(tail_start, tail_end, &t->tail_start, &copy_end, true);
+        copy_end->accept = accept;
+    }
+}
+
+/* Return the length of the strings matched by the fragment from *start* to
+ * *end* if all of them are of the same length, -1 otherwise. The length of
+ * the path to every state is recorded, a state reached by paths of different
+ * lengths(e.g. by a loop) makes the length vary. */
+static int fixed_len(nfa_t *start, nfa_t *end)
+{
+    int dist[MAX_NFA_STATES];   /* length of the path to each state, -1 if
+                                 * not reached yet */
+    nfa_t *stack[MAX_NFA_STATES];
+    nfa_t **sp = stack;
+    nfa_t *next[2];
+    nfa_t *p;
+    int d;
+    int i;
+
+    memset(dist, -1, sizeof(dist));
+    dist[start->nfa_id] = 0;
+    *sp++ = start;
+
+    while (sp > stack) {
+        p = *--sp;
+        if (p == end) {
+            continue;
+        }
+
+        next[0] = p->next1;
+        next[1] = (p->edge == EPSILON) ? p->next2 : NULL;
+        d = dist[p->nfa_id] + (p->edge == EPSILON ? 0 : 1);
+        for (i = 0; i < 2; i++) {
+            if (next[i] == NULL || p->edge == EMPTY) {
+                continue;
+            } else if (dist[next[i]->nfa_id] == -1) {
+                dist[next[i]->nfa_id] = d;
+                *sp++ = next[i];
+            } else if (dist[next[i]->nfa_id] != d) {
+                return -1;
+            }
+        }
+    }
+
+    return dist[end->nfa_id];
+}
+
+/* Copy the fragment from *start* to *end*, the copy is returned in *cstart*
+ * and *cend*. If *reverse*, every edge of the copy is turned around, so it
+ * matches the strings of the fragment reversed. The accepting strings are
+ * not copied. */
+static void copy(nfa_t *start, nfa_t *end, nfa_t **cstart, nfa_t **cend,
+                 bool reverse)
+{
+    nfa_t *map[MAX_NFA_STATES];     /* copy of each state, NULL if none */
+    nfa_t *states[MAX_NFA_STATES];  /* states of the fragment */
+    int nstates = 0;
+    nfa_t *next[2];
+    nfa_t *p;
+    nfa_t *label;
+    int i, j;
+
+    memset(map, 0, sizeof(map));
+    map[start->nfa_id] = new_state();
+    states[nstates++] = start;
+
+    for (i = 0; i < nstates; i++) {
+        p = states[i];
+        next[0] = (p == end) ? NULL : p->next1;
+        next[1] = (p == end || p->edge != EPSILON) ? NULL : p->next2;
+        for (j = 0; j < 2; j++) {
+            if (next[j] != NULL && map[next[j]->nfa_id] == NULL) {
+                map[next[j]->nfa_id] = new_state();
+                states[nstates++] = next[j];
+            }
+        }
+    }
+
+    for (i = 0; i < nstates; i++) {
+        p = states[i];
+        next[0] = (p == end || p->edge == EMPTY) ? NULL : p->next1;
+        next[1] = (p == end || p->edge != EPSILON) ? NULL : p->next2;
+
+        if (!reverse) {
+            map[p->nfa_id]->edge = p->edge;
+            map[p->nfa_id]->fold = p->fold;
+            map[p->nfa_id]->bitset = p->bitset;
+            map[p->nfa_id]->ccl = p->ccl;
+            map[p->nfa_id]->next1 = next[0] ? map[next[0]->nfa_id] : NULL;
+            map[p->nfa_id]->next2 = next[1] ? map[next[1]->nfa_id] : NULL;
+            continue;
+        }
+
+        /* p --c--> q becomes q' --> (c) --c--> p', the label moves to a
+         * state of its own as q' might have several edges */
+        label = map[p->nfa_id];
+        if (p->edge != EPSILON && next[0] != NULL) {
+            label = new_state();
+            label->edge = p->edge;
+            label->fold = p->fold;
+            label->bitset = p->bitset;
+            label->ccl = p->ccl;
+            label->next1 = map[p->nfa_id];
+        }
+        for (j = 0; j < 2; j++) {
+            if (next[j] != NULL) {
+                add_edge(map[next[j]->nfa_id], label);
+            }
+        }
+    }
+
+    *cstart = map[(reverse ? end : start)->nfa_id];
+    *cend = map[(reverse ? start : end)->nfa_id];
+}
+
+/* add an EPSILON edge from *state* to *next*, a new state is inserted if
+ * both edges of *state* are taken */
+static void add_edge(nfa_t *state, nfa_t *next)
+{
+    nfa_t *p;
+
+    if (state->next1 == NULL) {
+        state->next1 = next;
+    } else if (state->next2 == NULL) {
+        state->next2 = next;
+    } else {
+        p = new_state();
+        p->next1 = state->next1;
+        p->next2 = state->next2;
+        state->next1 = p;
+        state->next2 = next;
+    }
+}
+
 /*---------------------------------------------------------------------------*/
 /* Macro support
  *
@@ -3,6 +3,7 @@
 /*-----------------------------------------------------------------------------
  * nfa.h -- header file containning all the global information about NFA
  *---------------------------------------------------------------------------*/
+#include <stdint.h>
 #include "set.h"
 
 /*---------------------------------------------------------------------------*/
@@ -19,7 +20,9 @@ typedef struct nfa
 {
     int edge; /* label for edge: character, CCL, EMPTY or EPSILON */
 
-    set_t *bitset;  /* set to store character class(CCL) */
+    set_t *bitset;  /* set to store character class(CCL), shared by all the
+                       states of the same class, see thompson_ccls() */
+    int ccl;        /* ID of the class if edge == CCL */
 
     struct nfa *next1; /* next state (or NULL if none) */
     struct nfa *next2; /* another next state, not NULL only if edget ==
@@ -27,6 +30,8 @@ typedef struct nfa
     char *accept;   /* action string for accepting state. NULL if not
                        accepting state */
     anchor_t anchor;    /* anchor of regular expression */
+    bool fold;      /* case-insensitive: the input is folded by FOLD()
+                       before it is matched against the label */
     int nfa_id;     /* ID of nfa state */
 } nfa_t;
 
@@ -34,6 +39,14 @@ typedef struct nfa
 #define CCL -2
 #define EMPTY -3
 
+/* the class of a character under case folding: upper case letters fold to
+ * lower case, the labels of a case-insensitive state are kept folded */
+#define FOLD(c) (((c) >= 'A' && (c) <= 'Z') ? (c) - 'A' + 'a' : (c))
+
+/* header embedded in front of the accept strings */
+#define ACCEPT_LINE(a) (((int *)(a))[-1]) /* line number of the rule */
+#define ACCEPT_RULE(a) (((int *)(a))[-2]) /* rule number, starting from 0 */
+
 /*---------------------------------------------------------------------------*/
 /* extern const int MAX_NFA_STATES;     /\* max states in a NFA machine *\/ */
 #define MAX_NFA_STATES 788     /* max states in a NFA machine */
@@ -44,6 +57,83 @@ nfa_t *thompson(char *(*input_func)(void), nfa_t **start, int *max_state);
 /* free all the resources allocated by calling thompson() */
 void destory_thompson(void);
 
+/* free only the states, once the machine is in the compact layout */
+void destory_thompson_states(void);
+
+/* free the accepting strings of the machine built by the last thompson(),
+ * ACCEPT_RULE() and ACCEPT_LINE() of them could not be read afterwards.
+ * They are not freed by destory_thompson(), as a DFA keeps pointing at them:
+ * the strings of every machine that is not freed this way are kept until
+ * the program exits. */
+void thompson_free_strings(void);
+
+#define MAX_CONDS 32    /* max start conditions, including INITIAL */
+
+/* start conditions of the machine built by the last thompson(). Return the
+ * number of conditions, starts[c] is set to the start state of condition c,
+ * bol_starts[c] to its start state at the beginning of a line and names[c]
+ * to its name. Condition 0 is INITIAL, its start state at the beginning of
+ * a line is the one returned by thompson(). */
+int thompson_conds(nfa_t ***starts, nfa_t ***bol_starts, char ***names);
+
+/* the character classes of the machine built by the last thompson(). Every
+ * distinct class is stored once, *ccls* is set to the array of them indexed
+ * by the ID. Return the number of them. */
+int thompson_ccls(set_t ***ccls);
+
+/* trailing context r/s of a rule, only the part matched by r is the lexeme */
+typedef struct trail
+{
+    int rule;           /* rule number */
+    int head;           /* length of the strings matched by r if they are of
+                         * the same length, -1 otherwise */
+    int tail;           /* length of the strings matched by s, or -1 */
+    nfa_t *head_start;  /* both lengths vary: a copy of r that accepts on its
+                         * own, NULL otherwise */
+    nfa_t *tail_start;  /* and a copy of s that matches the strings reversed */
+} trail_t;
+
+/* rules with trailing context of the machine built by the last thompson().
+ * Return the number of them, *trails* is set to the array. */
+int thompson_trails(trail_t **trails);
+
+/* a finished machine in a compact layout: an array for each field, indexed
+ * by the state ID, with indices instead of pointers. The character classes
+ * and the accepting states are in tables of their own. */
+typedef struct nfa_table
+{
+    int nstates;
+    int32_t *label;     /* character, EPSILON, EMPTY or CCL_LABEL(k) */
+    int32_t *next1;     /* next state, -1 if none */
+    int32_t *next2;     /* another next state of an EPSILON state, -1 if none */
+    uint8_t *flags;     /* NFA_FOLD | NFA_ACCEPT */
+
+    int nccls;
+    set_t **ccls;       /* the character classes, indexed by the ID: the
+                           pool of thompson_ccls(), not a copy */
+
+    int naccepts;
+    int32_t *accept_state;  /* the accepting states, in ascending order */
+    char **accept;      /* their accepting strings */
+    anchor_t *anchor;   /* and anchors */
+} nfa_table_t;
+
+#define CCL_LABEL(k) (-4 - (k))     /* label of the class k */
+#define CCL_INDEX(l) (-4 - (l))     /* class of the label l */
+#define IS_CCL(l)    ((l) <= -4)
+
+#define NFA_FOLD   1    /* case-insensitive, see nfa_t.fold */
+#define NFA_ACCEPT 2    /* an accepting state */
+
+/* make the compact layout of the machine built by the last thompson() */
+nfa_table_t *nfa_table(const nfa_t *states, int nstates);
+
+/* destory the compact layout */
+void nfa_table_del(nfa_table_t *table);
+
+/* index of *state* in the accepting states of *table*, -1 if it does not
+ * accept */
+int nfa_table_accept(const nfa_table_t *table, int state);
 
 typedef enum {
     NFA_PLAIN,      /* plain text output */
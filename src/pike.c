@@ -0,0 +1,313 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "pike.h"
+
+/*-----------------------------------------------------------------------------
+ * pike.c -- the NFA as a program of a Pike VM
+ *
+ * terp.c walks the nfa_t states themselves: following a pointer for every
+ * edge and a separate set_t for every class. Here the NFA is lowered to a
+ * flat array of instructions, one for every state, so the program counter is
+ * the state ID:
+ *
+ *     character    CHAR c, or RANGE lo-hi or CLASS k for a class(or a
+ *                  case-insensitive letter)
+ *     EPSILON      SPLIT x y for two edges, JMP x for one, MATCH rule for
+ *                  an accepting state
+ *
+ * The classes are bitmaps kept in the same block right after the
+ * instructions.
+ *
+ * The VM runs all the threads in lockstep, one byte at a time. A thread is
+ * only a program counter: JMP and SPLIT are followed when a thread is added,
+ * so a step only looks at the instructions that read a byte. The lists are
+ * sparse sets(Briggs and Torczon), adding a thread and testing whether it is
+ * there are both O(1) and a list is cleared in O(1) as well. A MATCH found
+ * while adding the threads after byte i means a match of length i+1.
+ *---------------------------------------------------------------------------*/
+
+typedef struct thread_list
+{
+    int *dense;     /* the program counters in the list */
+    int *sparse;    /* index of every program counter in *dense* */
+    int n;
+} thread_list_t;
+
+static void lower(pike_t *pike, nfa_t *p, pike_inst_t *inst);
+static void add_thread(const pike_t *pike, thread_list_t *list, int *stack,
+                       int pc, int next, int *match);
+
+/*----------------------------------------------------------------------------*/
+/* compile the rules read by *input_func* */
+pike_t *pike_new(char *(*input_func)(void))
+{
+    pike_t *pike = NULL;
+    nfa_t *states;
+    nfa_t *start;
+    nfa_t **starts;
+    nfa_t **bol_starts;
+    trail_t *trails;
+    int max_state;
+    int nclasses = 0;
+    int i, c;
+
+    states = thompson(input_func, &start, &max_state);
+    if (thompson_trails(&trails) > 0) {
+        goto exit;
+    }
+    for (i = 0; i < max_state; i++) {
+        if (states[i].edge == CCL || (states[i].edge >= 0 &&
+                                      states[i].fold)) {
+            nclasses++;     /* at most, some become a CHAR or a RANGE */
+        }
+    }
+
+    pike = (pike_t *)malloc(sizeof(*pike) + max_state * sizeof(pike_inst_t) +
+                            nclasses * sizeof(pike_class_t));
+    if (pike == NULL) {
+        fprintf(stderr, "pike_new: not enough memory\n");
+        exit(1);
+    }
+    pike->code = (pike_inst_t *)(pike + 1);
+    pike->classes = (pike_class_t *)(pike->code + max_state);
+    pike->ninst = max_state;
+    pike->nclasses = 0;
+
+    for (i = 0; i < max_state; i++) {
+        lower(pike, &states[i], &pike->code[i]);
+    }
+    pike->nconds = thompson_conds(&starts, &bol_starts, NULL);
+    for (c = 0; c < pike->nconds; c++) {
+        pike->start[c] = starts[c]->nfa_id;
+        pike->bol[c] = bol_starts[c]->nfa_id;
+    }
+
+exit:
+    thompson_free_strings();    /* the rule numbers are copied */
+    destory_thompson();
+    return pike;
+}
+
+/* destory the program */
+void pike_del(pike_t *pike)
+{
+    free(pike);
+}
+
+/* scratch space to run *pike* in: two thread lists of a dense and a sparse
+ * array, and the stack where every thread pushes at most two. It is cleared
+ * only here, a sparse set is emptied by setting its size to 0. */
+pike_scratch_t *pike_scratch_new(const pike_t *pike)
+{
+    pike_scratch_t *scratch;
+
+    scratch = (pike_scratch_t *)malloc(sizeof(*scratch));
+    if (scratch != NULL) {
+        scratch->lists = (int *)calloc(6 * pike->ninst + 1, sizeof(int));
+    }
+    if (scratch == NULL || scratch->lists == NULL) {
+        fprintf(stderr, "pike_scratch_new: not enough memory\n");
+        exit(1);
+    }
+    scratch->ninst = pike->ninst;
+    return scratch;
+}
+
+/* destory the scratch space */
+void pike_scratch_del(pike_scratch_t *scratch)
+{
+    if (scratch == NULL) {
+        return;
+    }
+    free(scratch->lists);
+    free(scratch);
+}
+
+/* lower the NFA state *p* to *inst* */
+static void lower(pike_t *pike, nfa_t *p, pike_inst_t *inst)
+{
+    pike_class_t bits;
+    int first = -1;
+    int last = -1;
+    int count = 0;
+    int c;
+
+    memset(inst, 0, sizeof(*inst));
+    inst->x = (p->next1 != NULL) ? p->next1->nfa_id : -1;
+    inst->y = (p->next2 != NULL) ? p->next2->nfa_id : -1;
+
+    if (p->edge == EPSILON) {
+        if (p->accept != NULL) {
+            inst->op = PIKE_MATCH;
+            inst->arg = ACCEPT_RULE(p->accept);
+            inst->eol = (p->anchor & END) != 0;
+        } else {
+            inst->op = (inst->y >= 0) ? PIKE_SPLIT : PIKE_JMP;
+        }
+        return;
+    }
+    if (p->edge == EMPTY) {
+        inst->op = PIKE_JMP;
+        inst->x = -1;
+        return;
+    }
+
+    /* a character or a class, made a CHAR or a RANGE if it could be */
+    memset(bits, 0, sizeof(bits));
+    for (c = 0; c < MAX_CHARS; c++) {
+        int fc = p->fold ? FOLD(c) : c;
+        if (p->edge == fc ||
+            (p->edge == CCL && set_is_member(p->bitset, fc))) {
+            bits[c / 64] |= 1ull << (c % 64);
+            if (first < 0) {
+                first = c;
+            }
+            last = c;
+            count++;
+        }
+    }
+
+    if (count == 0) {
+        inst->op = PIKE_JMP;    /* an empty class never matches */
+        inst->x = -1;
+    } else if (count == last - first + 1) {
+        inst->op = (count == 1) ? PIKE_CHAR : PIKE_RANGE;
+        inst->lo = first;
+        inst->hi = last;
+    } else {
+        inst->op = PIKE_CLASS;
+        inst->arg = pike->nclasses;
+        memcpy(pike->classes[pike->nclasses++], bits, sizeof(bits));
+    }
+}
+
+/*----------------------------------------------------------------------------*/
+/* add the thread at *pc* to *list*, following JMP and SPLIT. *next* is the
+ * byte after the current position, -1 at the end of the buffer. If a MATCH
+ * is reached, *match* is lowered to its program counter: like the DFA, the
+ * accepting state of the lowest ID has the highest priority. */
+static void add_thread(const pike_t *pike, thread_list_t *list, int *stack,
+                       int pc, int next, int *match)
+{
+    const pike_inst_t *inst;
+    int top = 0;
+
+    stack[top++] = pc;
+    while (top > 0) {
+        pc = stack[--top];
+        if (pc < 0 || (list->sparse[pc] < list->n &&
+                       list->dense[list->sparse[pc]] == pc)) {
+            continue;   /* nowhere, or already there */
+        }
+        list->sparse[pc] = list->n;
+        list->dense[list->n++] = pc;
+
+        inst = &pike->code[pc];
+        switch (inst->op) {
+        case PIKE_SPLIT:
+            stack[top++] = inst->y;
+            stack[top++] = inst->x;
+            break;
+        case PIKE_JMP:
+            stack[top++] = inst->x;
+            break;
+        case PIKE_MATCH:
+            if ((!inst->eol || next == '\n') &&
+                (*match == F || pc < *match)) {
+                *match = pc;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+/* find the longest match at the beginning of *buf* */
+long pike_scan(const pike_t *pike, pike_scratch_t *scratch, int cond,
+               bool bol, const char *buf, long len, int *rule)
+{
+    const unsigned char *s = (const unsigned char *)buf;
+    const pike_inst_t *code = pike->code;
+    thread_list_t lists[2];
+    thread_list_t *clist = &lists[0];
+    thread_list_t *nlist = &lists[1];
+    thread_list_t *tmp;
+    const pike_inst_t *inst;
+    int *stack;
+    int *mem = scratch->lists;
+    long best = -1;
+    int r = F;      /* the MATCH of the highest priority */
+    long i;
+    int j, c;
+    int pc;
+
+    assert(scratch->ninst >= pike->ninst);
+    lists[0].dense = mem;
+    lists[0].sparse = mem + pike->ninst;
+    lists[1].dense = mem + 2 * pike->ninst;
+    lists[1].sparse = mem + 3 * pike->ninst;
+    stack = mem + 4 * pike->ninst;
+    lists[0].n = lists[1].n = 0;
+
+    add_thread(pike, clist, stack, bol ? pike->bol[cond] : pike->start[cond],
+               len > 0 ? s[0] : -1, &r);
+    if (r != F) {
+        best = 0;
+        *rule = code[r].arg;
+    }
+
+    for (i = 0; i < len && clist->n > 0; i++) {
+        c = s[i];
+        r = F;
+        nlist->n = 0;
+        for (j = 0; j < clist->n; j++) {
+            pc = clist->dense[j];
+            inst = &code[pc];
+            switch (inst->op) {
+            case PIKE_CHAR:
+                if (c == inst->lo) {
+                    break;
+                }
+                continue;
+            case PIKE_RANGE:
+                if (c >= inst->lo && c <= inst->hi) {
+                    break;
+                }
+                continue;
+            case PIKE_CLASS:
+                if (c < MAX_CHARS &&
+                    (pike->classes[inst->arg][c / 64] >> (c % 64) & 1)) {
+                    break;
+                }
+                continue;
+            default:
+                continue;
+            }
+            add_thread(pike, nlist, stack, inst->x,
+                       i + 1 < len ? s[i+1] : -1, &r);
+        }
+        if (r != F) {
+            best = i + 1;
+            *rule = code[r].arg;
+        }
+        tmp = clist;
+        clist = nlist;
+        nlist = tmp;
+    }
+
+    return best;
+}
+
+/* run the program over the whole of *buf*(an anchored full match) */
+int pike_match(const pike_t *pike, pike_scratch_t *scratch, const char *buf,
+               long len)
+{
+    int rule;
+
+    return pike_scan(pike, scratch, 0, true, buf, len, &rule) == len ?
+           rule : F;
+}
@@ -0,0 +1,83 @@
+#ifndef PIKE_H
+#define PIKE_H
+
+/*-----------------------------------------------------------------------------
+ * pike.h -- the NFA as a program of a Pike VM
+ *---------------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "nfa.h"
+#include "dfa.h"
+
+typedef enum {
+    PIKE_CHAR,      /* read the byte *lo* and go to x */
+    PIKE_RANGE,     /* read a byte from *lo* to *hi* and go to x */
+    PIKE_CLASS,     /* read a byte of the class *arg* and go to x */
+    PIKE_SPLIT,     /* go to both x and y */
+    PIKE_JMP,       /* go to x, nowhere if x < 0 */
+    PIKE_MATCH,     /* accept the rule *arg*, only before a newline if *eol* */
+} pike_op_t;
+
+/* one instruction, the program counter of an instruction is the ID of the
+ * NFA state it comes from */
+typedef struct pike_inst
+{
+    unsigned char op;   /* pike_op_t */
+    unsigned char lo;
+    unsigned char hi;
+    unsigned char eol;
+    int arg;
+    int x;
+    int y;
+} pike_inst_t;
+
+/* a character class, one bit for every byte < MAX_CHARS */
+typedef uint64_t pike_class_t[MAX_CHARS/64];
+
+typedef struct pike
+{
+    pike_inst_t *code;      /* the instructions */
+    pike_class_t *classes;  /* the classes, right after the instructions */
+    int ninst;
+    int nclasses;
+    int nconds;             /* number of start conditions */
+    int start[MAX_CONDS];   /* program counter of every condition */
+    int bol[MAX_CONDS];     /* and at the beginning of a line */
+} pike_t;
+
+/* the thread lists and the stack pike_scan() runs in. The program is never
+ * written after pike_new(), so one program is shared by any number of
+ * threads, each with scratch space of its own. */
+typedef struct pike_scratch
+{
+    int *lists;
+    int ninst;              /* size of the program it is made for */
+} pike_scratch_t;
+
+/*----------------------------------------------------------------------------*/
+/* compile the rules read by *input_func*, the same specification as
+ * thompson() takes, return NULL if it uses trailing context. */
+pike_t *pike_new(char *(*input_func)(void));
+
+/* destory the program */
+void pike_del(pike_t *pike);
+
+/* scratch space to run *pike* in, allocated once for every thread */
+pike_scratch_t *pike_scratch_new(const pike_t *pike);
+
+/* destory the scratch space */
+void pike_scratch_del(pike_scratch_t *scratch);
+
+/* find the longest match at the beginning of *buf* in condition *cond*,
+ * starting at the beginning of a line if *bol*. Return its length, -1 if
+ * there is none. *rule* is set to the rule number of the match, the first
+ * rule if several rules match it. The threads are kept in *scratch*. */
+long pike_scan(const pike_t *pike, pike_scratch_t *scratch, int cond,
+               bool bol, const char *buf, long len, int *rule);
+
+/* run the program over the whole of *buf*(an anchored full match), return
+ * the rule number it accepts, F if none. The same as zlex_match(). */
+int pike_match(const pike_t *pike, pike_scratch_t *scratch, const char *buf,
+               long len);
+
+#endif /* end of include guard: PIKE_H */
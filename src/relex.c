@@ -0,0 +1,207 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "relex.h"
+
+/*-----------------------------------------------------------------------------
+ * relex.c -- incremental re-lexing of an edited buffer
+ *
+ * Every token boundary is a checkpoint: the DFA always starts a token in the
+ * start state, so scanning could restart at any boundary. Because of maximal
+ * munch a token might depend on bytes after its end, so we also record how
+ * far the DFA read(the reach). The reach is kept as a running maximum over
+ * the tokens so that it could be binary searched. After an edit at *offset*:
+ *
+ * 1. The first token to scan again is the first one whose reach is beyond
+ *    *offset*, everything before it is unchanged.
+ * 2. Scanning restarts at the beginning of that token and stops as soon as a
+ *    new token ends at the (shifted) boundary of an old token that lies
+ *    behind the edit. From there on both the text and the DFA state are the
+ *    same as before, so are the remaining tokens. With rules anchored by ^
+ *    the start state depends on the byte before the token too, so the old
+ *    token should lie at least one byte behind the edit.
+ *
+ * So only the tokens around the edit are scanned again, the remaining ones
+ * are only shifted by the size difference of the edit. The reach of the
+ * shifted tokens might be overestimated afterwards, which could only cause
+ * an earlier restart, never a wrong result.
+ *---------------------------------------------------------------------------*/
+
+static void enlarge(relex_t *relex, int need);
+
+/*----------------------------------------------------------------------------*/
+/* scan the whole buffer and record its tokens. buf[len] must be SENTINEL. */
+relex_t *zlex_relex_new(scanner_t *scanner, const char *buf, long len)
+{
+    relex_t *relex;
+    token_t token;
+    long reach = 0;
+
+    relex = (relex_t *)calloc(1, sizeof(*relex));
+    if (relex == NULL) {
+        fprintf(stderr, "zlex_relex_new: not enough memory\n");
+        exit(1);
+    }
+    relex->scanner = scanner;
+
+    zlex_scan_buffer(scanner, buf, len);
+    while (zlex_token(scanner, &token)) {
+        enlarge(relex, relex->ntokens + 1);
+        if (scanner->jam - scanner->buf + 1 > reach) {
+            reach = scanner->jam - scanner->buf + 1;
+        }
+        relex->tokens[relex->ntokens] = token;
+        relex->reach[relex->ntokens] = reach;
+        relex->ntokens++;
+    }
+
+    return relex;
+}
+
+/* destory the record, the scanner is not freed */
+void zlex_relex_del(relex_t *relex)
+{
+    if (relex == NULL) {
+        return;
+    }
+    free(relex->tokens);
+    free(relex->reach);
+    free(relex);
+}
+
+/*----------------------------------------------------------------------------*/
+/* update the tokens after an edit that replaced *removed* bytes at *offset*
+ * with *inserted* bytes. Return the index of the first changed token. */
+int zlex_relex(relex_t *relex, const char *buf, long len, long offset,
+               long removed, long inserted, int *nold, int *nnew)
+{
+    scanner_t *scanner = relex->scanner;
+    token_t *tokens = relex->tokens;
+    long delta = inserted - removed;
+    long after = offset + removed; /* old offset of the first byte after the
+                                    * edit */
+    int context = (scanner->lex->bol[scanner->start] != scanner->start);
+                    /* 1 if a token depends on the byte before it */
+    token_t *new_tokens = NULL;
+    long *new_reach = NULL;
+    int size = 0;
+    int n = 0;
+    int lo, hi, mid;
+    int first;
+    int j;
+    long pos;
+    long reach;
+    token_t token;
+
+    /* 1. find the first token that read into the edit */
+    lo = 0;
+    hi = relex->ntokens;
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (relex->reach[mid] <= offset) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    first = lo;
+
+    /* 2. scan again from the boundary until the tokens get in sync */
+    zlex_scan_buffer(scanner, buf, len);
+    if (first < relex->ntokens) {
+        scanner->cur = scanner->buf + tokens[first].offset;
+    } else if (first > 0) {
+        scanner->cur = scanner->buf + tokens[first-1].offset +
+                       tokens[first-1].len;
+    }
+    reach = first > 0 ? relex->reach[first-1] : 0;
+
+    j = first;
+    for (;;) {
+        if (!zlex_token(scanner, &token)) {
+            j = relex->ntokens; /* the end without getting in sync, all the
+                                 * old tokens from *first* on are gone */
+            break;
+        }
+        if (n >= size) {
+            size = size ? size * 2 : 16;
+            new_tokens = (token_t *)realloc(new_tokens,
+                                            size * sizeof(*new_tokens));
+            new_reach = (long *)realloc(new_reach,
+                                        size * sizeof(*new_reach));
+            if (new_tokens == NULL || new_reach == NULL) {
+                fprintf(stderr, "zlex_relex: not enough memory\n");
+                exit(1);
+            }
+        }
+        if (scanner->jam - scanner->buf + 1 > reach) {
+            reach = scanner->jam - scanner->buf + 1;
+        }
+        new_tokens[n] = token;
+        new_reach[n] = reach;
+        n++;
+
+        pos = token.offset + token.len;
+        while (j < relex->ntokens &&
+               (tokens[j].offset < after + context ||
+                tokens[j].offset + delta < pos)) {
+            j++;
+        }
+        if (j < relex->ntokens && tokens[j].offset + delta == pos) {
+            break;  /* in sync with the old tokens */
+        }
+    }
+
+    /* 3. replace tokens[first ... j-1] with the new tokens, shift the rest */
+    *nold = j - first;
+    *nnew = n;
+    enlarge(relex, relex->ntokens - *nold + n);
+    tokens = relex->tokens;
+
+    if (j < relex->ntokens) {
+        memmove(&tokens[first + n], &tokens[j],
+                (relex->ntokens - j) * sizeof(*tokens));
+        memmove(&relex->reach[first + n], &relex->reach[j],
+                (relex->ntokens - j) * sizeof(*relex->reach));
+    }
+    relex->ntokens += n - *nold;
+
+    for (j = first + n; j < relex->ntokens; j++) {
+        tokens[j].offset += delta;
+        relex->reach[j] += delta;
+        if (relex->reach[j] < reach) {
+            relex->reach[j] = reach;
+        }
+    }
+
+    if (n > 0) {
+        memcpy(&tokens[first], new_tokens, n * sizeof(*tokens));
+        memcpy(&relex->reach[first], new_reach, n * sizeof(*new_reach));
+    }
+    free(new_tokens);
+    free(new_reach);
+
+    return first;
+}
+
+/*----------------------------------------------------------------------------*/
+/* make room for at least *need* tokens */
+static void enlarge(relex_t *relex, int need)
+{
+    if (need <= relex->size) {
+        return;
+    }
+
+    while (relex->size < need) {
+        relex->size = relex->size ? relex->size * 2 : 64;
+    }
+    relex->tokens = (token_t *)realloc(relex->tokens,
+                                       relex->size * sizeof(*relex->tokens));
+    relex->reach = (long *)realloc(relex->reach,
+                                   relex->size * sizeof(*relex->reach));
+    if (relex->tokens == NULL || relex->reach == NULL) {
+        fprintf(stderr, "enlarge: not enough memory for tokens\n");
+        exit(1);
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef RELEX_H
+#define RELEX_H
+
+/*-----------------------------------------------------------------------------
+ * relex.h -- incremental re-lexing of an edited buffer
+ *---------------------------------------------------------------------------*/
+#include "scan.h"
+
+/* the token stream of a buffer, kept up to date across edits */
+typedef struct relex
+{
+    scanner_t *scanner; /* scanner used to (re)scan the buffer */
+    token_t *tokens;    /* tokens of the whole buffer */
+    long *reach;        /* reach[i]: one past the last byte examined while
+                         * scanning tokens[0 ... i], tokens[i] has to be
+                         * scanned again if an edit starts before it */
+    int ntokens;        /* number of tokens */
+    int size;           /* allocated size of tokens and reach */
+} relex_t;
+
+/*----------------------------------------------------------------------------*/
+/* scan the whole buffer and record its tokens. buf[len] must be SENTINEL.
+ * The scanner is used in zlex_scan_buffer() mode and is not freed. */
+relex_t *zlex_relex_new(scanner_t *scanner, const char *buf, long len);
+
+/* destory the record, the scanner is not freed */
+void zlex_relex_del(relex_t *relex);
+
+/* update the tokens after an edit that replaced *removed* bytes at *offset*
+ * with *inserted* bytes, *buf* and *len* describe the edited buffer. Only
+ * the tokens around the edit are scanned again. Return the index of the
+ * first changed token, *nold* is set to the number of tokens replaced and
+ * *nnew* to the number of tokens that replaced them, which are at
+ * relex->tokens[index ... index+*nnew-1]. */
+int zlex_relex(relex_t *relex, const char *buf, long len, long offset,
+               long removed, long inserted, int *nold, int *nnew);
+
+#endif /* end of include guard: RELEX_H */
@@ -0,0 +1,1166 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+
+#include "scan.h"
+#include "backup.h"
+#include "sheng.h"
+#include "stride.h"
+
+/*-----------------------------------------------------------------------------
+ * scan.c -- the scanner runtime
+ *
+ * The input is read into a buffer that is always terminated by a SENTINEL
+ * byte, just like flex does. The column of SENTINEL in the runtime table is a
+ * failure transition in every state, so the inner loop only needs to check
+ * for F, which it has to do anyway, instead of checking for the end of
+ * buffer on every byte:
+ *
+ *     while ((next = trans[state][*cp]) != F) { ... cp++; }
+ *
+ * Only after the loop jams we check whether it jammed on the SENTINEL at the
+ * end of buffer. If so, the buffer is refilled and the DFA resumes from the
+ * state it was in. A token that crosses the buffer boundary is moved to the
+ * beginning of the buffer(compaction) before refilling, the buffer is only
+ * enlarged if a single token is longer than the whole buffer.
+ *
+ * A NUL in the data is the same byte as SENTINEL, it is told apart by its
+ * position and its transition is looked up in the original Dtrans.
+ *
+ * Tokens are returned as spans (rule, offset, length) of the input, so
+ * scanning a buffer of the caller(or a mapped file) copies nothing at all.
+ * The lexeme is only copied out when zlex_lexeme() is called.
+ *
+ * zlex_scan_batch() scans a whole run of tokens in one call, all the scanner
+ * state lives in local variables for the run, and the tokens are stored in
+ * parallel arrays of the caller.
+ *
+ * In push mode the caller feeds chunks of input with zlex_feed() instead of
+ * providing input(). When a chunk runs out in the middle of a token, the DFA
+ * state and the last accept of the pending token are saved in the scanner
+ * and the DFA resumes from there on the next chunk, so it never blocks and
+ * only the pending token is kept in the buffer.
+ *
+ * States that loop on themselves for most bytes(e.g. the body of a comment)
+ * or only loop on a few bytes(e.g. white spaces) are accelerated, just like
+ * Hyperscan does. When such a state takes its self loop, the following bytes
+ * are compared 16(or 32) at a time with the few bytes that leave(or stay in)
+ * the state by SIMD, and the DFA jumps right to the byte that leaves it.
+ *
+ * When the pair table of stride.c is small enough, the DFA takes two bytes
+ * per transition out of accelerated states. The byte table gives the state
+ * in the middle of the pair, so an accept there is not missed. The first
+ * byte of a pair is never the SENTINEL at the end of buffer(its transition
+ * is F), so the second one is always readable.
+ *
+ * zlex_scan_streams() interleaves the DFAs of several short buffers, one
+ * transition of each per round. The transitions of different streams do not
+ * depend on each other, so the CPU overlaps their loads(and cache misses)
+ * instead of waiting for a single chain.
+ *
+ * Every start condition has its own start state in the table(state c for
+ * condition c), a token is scanned from the start state of the current
+ * condition, so switching conditions is only an assignment.
+ *
+ * Anchors are zero width. A condition with rules anchored by ^ has another
+ * start state for tokens at the beginning of a line, chosen by the byte
+ * before the token. A state accepting a rule anchored by $ accepts another
+ * rule(nl_rule) when the next byte is a newline, so the accept is checked
+ * against the byte after it, which the DFA examines anyway.
+ *
+ * A rule with trailing context r/s is matched as rs, only the part matched by
+ * r is the lexeme and the rest is scanned again as the following tokens.
+ * Where r ends is mostly a constant offset from either end of the match, see
+ * trail_end().
+ *
+ * When no state could need backing up(see backup.c), a token always ends
+ * where the DFA jams, in an accepting state. Then zlex_scan() and
+ * zlex_scan_batch() run a variant of the loop that does not track the last
+ * accept at all: both are written once as an inline function with a
+ * constant *backup* flag, and the compiler drops the dead checks.
+ *
+ * The tables are compiled once into a lexer_t, which is only read from then
+ * on. A scanner is just a cursor: the buffer and the DFA state of one input,
+ * so many threads could scan with the same lexer, each with its own cursor.
+ *
+ * Line numbers are not counted in the DFA loop at all. Newlines are indexed
+ * only when positions are asked for(see lines.c), when reading from input()
+ * the bytes are indexed right before compaction drops them.
+ *---------------------------------------------------------------------------*/
+
+static void find_accel(lexer_t *lex);
+static inline const char *accel_skip(const accel_t *accel, const char *cp,
+                                     const char *end);
+static inline int start_state(const scanner_t *s, const char *cp);
+static inline const char *trail_end(const lexer_t *lex, int state, int rule,
+                                    const char *text, const char *end);
+static int split_trail(const lexer_t *lex, const accept_t *accept,
+                       const char *text, int len);
+static void compact(scanner_t *s);
+static void index_lines(scanner_t *s, long upto);
+static bool refill(scanner_t *s, char **cp, char **last_cp);
+static void push_scan(scanner_t *s, emit_func emit, void *arg, bool at_eof);
+static inline int scan(scanner_t *s, const bool backup)
+    __attribute__((always_inline));
+static inline int scan_batch(scanner_t *s, const char *buf, batch_t *out,
+                             int cap, const bool backup)
+    __attribute__((always_inline));
+
+/* the rule accepted in *state* when the next byte is *c*, F if none. It
+ * needs the tables *rule* and *nl_rule* in local variables. */
+#define ACCEPTS(state, c) (((c) == '\n' ? nl_rule : rule)[state])
+
+/*----------------------------------------------------------------------------*/
+/* compile the tables returned by dfa() into a lexer with one reference */
+lexer_t *zlex_compile(ROW *dtrans, accept_t *accept, int nstates)
+{
+    return zlex_compile_flags(dtrans, accept, nstates, 0);
+}
+
+/* compile the tables, without the speedups of *flags* */
+lexer_t *zlex_compile_flags(ROW *dtrans, accept_t *accept, int nstates,
+                            unsigned flags)
+{
+    lexer_t *lex;
+    int state;
+    int c;
+
+    lex = (lexer_t *)calloc(1, sizeof(*lex));
+    if (lex == NULL) {
+        fprintf(stderr, "zlex_compile: not enough memory allocating lexer\n");
+        exit(1);
+    }
+
+    lex->trans = (BYTE_ROW *)malloc(nstates * sizeof(BYTE_ROW));
+    lex->rule = (int *)malloc(nstates * sizeof(int));
+    lex->nl_rule = (int *)malloc(nstates * sizeof(int));
+    lex->bol = (int *)malloc(nstates * sizeof(int));
+    lex->accel = (accel_t *)calloc(nstates, sizeof(accel_t));
+    if (lex->trans == NULL || lex->rule == NULL || lex->nl_rule == NULL ||
+        lex->bol == NULL || lex->accel == NULL) {
+        fprintf(stderr, "zlex_compile: not enough memory allocating table\n");
+        exit(1);
+    }
+
+    /* widen the table, bytes out of the range of Dtrans never match */
+    for (state = 0; state < nstates; state++) {
+        for (c = 0; c < MAX_BYTES; c++) {
+            lex->trans[state][c] = c < MAX_CHARS ? dtrans[state][c] : F;
+        }
+        lex->trans[state][SENTINEL] = F;
+        lex->rule[state] = accept[state].string ? accept[state].rule : F;
+        lex->nl_rule[state] = accept[state].eol ? accept[state].eol_rule :
+                                                  lex->rule[state];
+        lex->bol[state] = accept[state].bol;
+        if (accept[state].string != NULL && accept[state].tail != 0) {
+            lex->trail = true;
+        }
+    }
+    lex->nstates = nstates;
+    lex->nconds = dfa_conds(NULL);
+    lex->backup = dfa_backup(dtrans, accept, nstates, NULL) > 0;
+    if (!(flags & ZLEX_NO_ACCEL)) {
+        find_accel(lex);
+    }
+    lex->sheng = sheng_new(dtrans, accept, nstates);
+    lex->stride = stride_new(lex->trans, nstates);
+
+    lex->dtrans = dtrans;
+    lex->accept = accept;
+    lex->refs = 1;
+
+    return lex;
+}
+
+/* take one more reference of the lexer */
+lexer_t *zlex_lexer_ref(lexer_t *lex)
+{
+    __atomic_add_fetch(&lex->refs, 1, __ATOMIC_RELAXED);
+    return lex;
+}
+
+/* drop a reference of the lexer, it is freed with the last one */
+void zlex_lexer_unref(lexer_t *lex)
+{
+    if (lex == NULL || __atomic_sub_fetch(&lex->refs, 1, __ATOMIC_ACQ_REL)) {
+        return;
+    }
+    free(lex->trans);
+    free(lex->rule);
+    free(lex->nl_rule);
+    free(lex->bol);
+    free(lex->accel);
+    sheng_del(lex->sheng);
+    stride_del(lex->stride);
+    free(lex);
+}
+
+/* create a scanner over a compiled lexer. *size* is the size of the input
+ * buffer, 0 for SCAN_BUF_SIZE. */
+scanner_t *zlex_cursor(lexer_t *lex, int (*input)(char *buf, int max),
+                       int size)
+{
+    scanner_t *s;
+
+    if (size <= 0) {
+        size = SCAN_BUF_SIZE;
+    }
+
+    s = (scanner_t *)calloc(1, sizeof(*s));
+    if (s == NULL) {
+        fprintf(stderr, "zlex_cursor: not enough memory allocating scanner\n");
+        exit(1);
+    }
+
+    s->own = s->buf = (char *)malloc(size + 1);
+    if (s->buf == NULL) {
+        fprintf(stderr, "zlex_cursor: not enough memory allocating buffer\n");
+        exit(1);
+    }
+
+    s->lex = zlex_lexer_ref(lex);
+    s->input = input;
+    s->size = size;
+    s->base = 0;
+    s->cur = s->end = s->text = s->buf;
+    *s->end = SENTINEL;
+    s->eof = false;
+    s->bol = true;
+    s->start = 0;
+    s->state = start_state(s, s->buf);
+    s->last_accept = F;
+    s->pos = s->last = s->buf;
+
+    return s;
+}
+
+/* create a scanner over the tables returned by dfa(), compiled for this
+ * scanner alone. */
+scanner_t *zlex_open(ROW *dtrans, accept_t *accept, int nstates,
+                     int (*input)(char *buf, int max), int size)
+{
+    lexer_t *lex = zlex_compile(dtrans, accept, nstates);
+    scanner_t *s = zlex_cursor(lex, input, size);
+
+    zlex_lexer_unref(lex);  /* the scanner holds the only reference */
+    return s;
+}
+
+/* destory a scanner */
+void zlex_close(scanner_t *s)
+{
+    if (s == NULL) {
+        return;
+    }
+    zlex_lexer_unref(s->lex);
+    free(s->own);
+    lines_del(s->lines);
+    free(s);
+}
+
+/*----------------------------------------------------------------------------*/
+/* Acceleration */
+
+/* Find the states that are worth accelerating: the self loop of the state
+ * covers all but MAX_ACCEL bytes(the exit bytes are recorded), or only
+ * MAX_ACCEL bytes(the loop bytes are recorded). SENTINEL is always an exit
+ * byte, so skipping never runs past the end of buffer. */
+static void find_accel(lexer_t *lex)
+{
+    accel_t *accel;
+    unsigned char loop[MAX_ACCEL];
+    unsigned char exits[MAX_ACCEL];
+    int nloop;
+    int nexit;
+    int high_loop;  /* bytes >= MAX_CHARS that loop */
+    int state;
+    int c;
+
+    for (state = 0; state < lex->nstates; state++) {
+        if (lex->nl_rule[state] != lex->rule[state]) {
+            continue;   /* every byte has to be checked for a newline */
+        }
+        nloop = nexit = high_loop = 0;
+        for (c = 0; c < MAX_BYTES; c++) {
+            if (lex->trans[state][c] != state) {
+                if (c < MAX_CHARS && nexit++ < MAX_ACCEL) {
+                    exits[nexit-1] = c;
+                }
+            } else if (c >= MAX_CHARS) {
+                high_loop++;
+            } else if (nloop++ < MAX_ACCEL) {
+                loop[nloop-1] = c;
+            }
+        }
+
+        if (nloop == 0 || high_loop != 0) {
+            continue;   /* no self loop, or bytes >= MAX_CHARS loop */
+        }
+
+        accel = &lex->accel[state];
+        if (nexit <= MAX_ACCEL) {
+            accel->stay = false;
+            accel->nbytes = nexit;
+            for (c = 0; c < MAX_ACCEL; c++) {
+                accel->bytes[c] = exits[c < nexit ? c : 0];
+            }
+        } else if (nloop <= MAX_ACCEL) {
+            accel->stay = true;
+            accel->nbytes = nloop;
+            for (c = 0; c < MAX_ACCEL; c++) {
+                accel->bytes[c] = loop[c < nloop ? c : 0];
+            }
+        }
+    }
+}
+
+/* Skip from *cp* to the first byte that leaves the accelerated state. The
+ * position returned might be before such a byte when less than a vector of
+ * bytes is left before *end*, the DFA goes on from there byte by byte. */
+static inline const char *accel_skip(const accel_t *accel, const char *cp,
+                                     const char *end)
+{
+#ifdef __AVX2__
+    const __m256i w0 = _mm256_set1_epi8(accel->bytes[0]);
+    const __m256i w1 = _mm256_set1_epi8(accel->bytes[1]);
+    const __m256i w2 = _mm256_set1_epi8(accel->bytes[2]);
+    const __m256i w3 = _mm256_set1_epi8(accel->bytes[3]);
+    __m256i wide;
+    unsigned wide_mask;
+
+    while (end - cp >= 32) {
+        wide = _mm256_loadu_si256((const __m256i *)cp);
+        wide_mask = _mm256_movemask_epi8(_mm256_or_si256(
+                    _mm256_or_si256(_mm256_cmpeq_epi8(wide, w0),
+                                    _mm256_cmpeq_epi8(wide, w1)),
+                    _mm256_or_si256(_mm256_cmpeq_epi8(wide, w2),
+                                    _mm256_cmpeq_epi8(wide, w3))));
+        if (accel->stay) {
+            wide_mask = ~wide_mask;
+        } else {
+            wide_mask |= _mm256_movemask_epi8(wide); /* bytes >= 0x80 */
+        }
+        if (wide_mask != 0) {
+            return cp + __builtin_ctz(wide_mask);
+        }
+        cp += 32;
+    }
+#endif
+
+#ifdef __SSE2__
+    const __m128i b0 = _mm_set1_epi8(accel->bytes[0]);
+    const __m128i b1 = _mm_set1_epi8(accel->bytes[1]);
+    const __m128i b2 = _mm_set1_epi8(accel->bytes[2]);
+    const __m128i b3 = _mm_set1_epi8(accel->bytes[3]);
+    __m128i chunk;
+    unsigned mask;
+
+    while (end - cp >= 16) {
+        chunk = _mm_loadu_si128((const __m128i *)cp);
+        mask = _mm_movemask_epi8(_mm_or_si128(
+               _mm_or_si128(_mm_cmpeq_epi8(chunk, b0), _mm_cmpeq_epi8(chunk, b1)),
+               _mm_or_si128(_mm_cmpeq_epi8(chunk, b2), _mm_cmpeq_epi8(chunk, b3))));
+        if (accel->stay) {
+            mask = ~mask & 0xFFFF;
+        } else {
+            mask |= _mm_movemask_epi8(chunk); /* bytes >= 0x80 */
+        }
+        if (mask != 0) {
+            return cp + __builtin_ctz(mask);
+        }
+        cp += 16;
+    }
+#endif
+
+    return cp;
+}
+
+/*----------------------------------------------------------------------------*/
+/* scan the next token with maximal munch. Return the accepting DFA state of
+ * the token, F if no rule matches (a single byte is consumed), or SCAN_EOF at
+ * the end of input. The lexeme is left in scanner->text and scanner->leng. */
+int zlex_scan(scanner_t *s)
+{
+    return s->lex->backup ? scan(s, true) : scan(s, false);
+}
+
+/* zlex_scan(), the last accept is only tracked if *backup* */
+static inline int scan(scanner_t *s, const bool backup)
+{
+    BYTE_ROW *trans = s->lex->trans;
+    accel_t *accel = s->lex->accel;
+    stride_t *stride = s->lex->stride;
+    int *rule = s->lex->rule;
+    int *nl_rule = s->lex->nl_rule;
+    char *cp;           /* current position */
+    char *last_cp;      /* end of the last accepted lexeme */
+    int last_accept;    /* last accepting state, F if none */
+    int state;
+    int next;
+    int pair;
+
+    s->text = s->cur;
+    if (s->cur == s->end) {
+        cp = last_cp = s->cur;
+        if (!refill(s, &cp, &last_cp)) {
+            s->leng = 0;
+            s->rule = F;
+            return SCAN_EOF;
+        }
+    }
+
+    cp = last_cp = s->text;
+    state = start_state(s, cp);
+    last_accept = F;
+
+    for (;;) {
+        while ((next = trans[state][(unsigned char)*cp]) != F) {
+            if (next == state && accel[state].nbytes != 0) {
+                cp = (char *)accel_skip(&accel[state], cp + 1, s->end);
+            } else if (stride != NULL && (pair = STRIDE_NEXT(stride, state,
+                       (unsigned char *)cp)) != F) {
+                if (backup && ACCEPTS(next, cp[1]) != F) {  /* in the middle */
+                    last_accept = next;
+                    last_cp = cp + 1;
+                }
+                state = pair;
+                cp += 2;
+            } else {
+                state = next;
+                cp++;
+            }
+            if (backup && ACCEPTS(state, *cp) != F) {
+                last_accept = state;
+                last_cp = cp;
+            }
+        }
+
+        if (cp < s->end) {
+            /* jammed. A NUL in the data shares the column of SENTINEL. */
+            if (*cp == SENTINEL && (next = s->lex->dtrans[state][0]) != F) {
+                state = next;
+                cp++;
+                if (backup && ACCEPTS(state, *cp) != F) {
+                    last_accept = state;
+                    last_cp = cp;
+                }
+                continue;
+            }
+            break;
+        }
+
+        /* took the SENTINEL transition at the end of buffer */
+        if (!refill(s, &cp, &last_cp)) {
+            break;
+        }
+        if (backup && cp > s->text && ACCEPTS(state, *cp) != F) {
+            last_accept = state;    /* the next byte was not read yet */
+            last_cp = cp;
+        }
+    }
+
+    if (!backup && cp > s->text) {
+        last_accept = state;    /* every state entered by a transition */
+        last_cp = cp;
+    }
+    if (last_accept == F) {
+        last_cp = s->text + 1; /* no rule matches, skip a single byte */
+        s->rule = F;
+    } else {
+        s->rule = ACCEPTS(last_accept, *last_cp);
+        last_cp = (char *)trail_end(s->lex, last_accept, s->rule, s->text,
+                                    last_cp);
+    }
+
+    s->leng = last_cp - s->text;
+    s->cur = last_cp;
+    s->jam = cp;
+    return last_accept;
+}
+
+/* switch to start condition *cond*, the next token is scanned from its
+ * start state */
+void zlex_begin(scanner_t *s, int cond)
+{
+    if (cond < 0 || cond >= s->lex->nconds) {
+        fprintf(stderr, "zlex_begin: no start condition %d\n", cond);
+        exit(1);
+    }
+    s->start = cond;
+    if (s->pos == s->text) {
+        s->state = start_state(s, s->pos);  /* push mode: no pending token */
+    }
+}
+
+/* run the DFA over the whole of *buf*, return the rule number of the state
+ * it ends in, F if it is not accepting. */
+int zlex_match(const lexer_t *lex, const char *buf, long len)
+{
+    const unsigned char *p = (const unsigned char *)buf;
+    const unsigned char *end = p + len;
+    int state = lex->bol[0];
+
+    if (lex->sheng != NULL) {
+        return sheng_match(lex->sheng, buf, len);
+    }
+
+    for (; p < end; p++) {
+        if (*p >= MAX_CHARS || (state = lex->dtrans[state][*p]) == F) {
+            return F;
+        }
+    }
+    return lex->rule[state];
+}
+
+/*----------------------------------------------------------------------------*/
+/* the start state of a token at *cp*, it depends on whether the token is at
+ * the beginning of a line */
+static inline int start_state(const scanner_t *s, const char *cp)
+{
+    bool bol = (cp > s->buf) ? cp[-1] == '\n' : s->bol;
+    return bol ? s->lex->bol[s->start] : s->start;
+}
+
+/* the end of the lexeme of a token from *text* to *end*, accepted by *rule*
+ * in *state*. It is before *end* if the rule has trailing context. */
+static inline const char *trail_end(const lexer_t *lex, int state, int rule,
+                                    const char *text, const char *end)
+{
+    const accept_t *accept;
+
+    if (!lex->trail) {
+        return end;
+    }
+
+    accept = &lex->accept[state];
+    if (accept->tail == 0 || rule != accept->rule) {
+        return end;     /* no trailing context */
+    } else if (accept->head >= 0) {
+        return text + accept->head;
+    } else if (accept->tail > 0) {
+        return end - accept->tail;
+    }
+    return text + split_trail(lex, accept, text, end - text);
+}
+
+/* Find where r ends in a match of r/s of *len* bytes when neither of them
+ * is of a fixed length. r alone is run forward over the match to mark where
+ * it accepts, then s reversed is run backward from the end, the first mark
+ * it accepts at is where r ends. So r is as long as possible. */
+static int split_trail(const lexer_t *lex, const accept_t *accept,
+                       const char *text, int len)
+{
+    const unsigned char *p = (const unsigned char *)text;
+    char marks[256];    /* marks[i]: r matches the first i bytes */
+    char *ends = marks;
+    int state;
+    int i;
+
+    if (len >= (int)sizeof(marks)) {
+        ends = (char *)malloc(len + 1);
+        if (ends == NULL) {
+            fprintf(stderr, "split_trail: not enough memory\n");
+            exit(1);
+        }
+    }
+    memset(ends, 0, len + 1);
+
+    state = accept->head_start;
+    for (i = 0; state != F; i++) {
+        ends[i] = (lex->rule[state] != F);
+        if (i == len || p[i] >= MAX_CHARS) {
+            break;
+        }
+        state = lex->dtrans[state][p[i]];
+    }
+
+    state = accept->tail_start;
+    for (i = len; state != F; i--) {
+        if (lex->rule[state] != F && ends[i]) {
+            break;
+        }
+        if (i == 0 || p[i-1] >= MAX_CHARS) {
+            i = len;    /* not found, should not happen */
+            break;
+        }
+        state = lex->dtrans[state][p[i-1]];
+    }
+    if (state == F) {
+        i = len;
+    }
+
+    if (ends != marks) {
+        free(ends);
+    }
+    return i;
+}
+
+/* Move the partial token starting at s->text to the beginning of the buffer,
+ * the buffer is only enlarged if the partial token fills all of it. Pointers
+ * into the partial token are invalidated. */
+static void compact(scanner_t *s)
+{
+    int keep = s->end - s->text;    /* bytes of the partial token */
+
+    if (s->lines != NULL) {
+        index_lines(s, s->base + (s->text - s->buf));
+    }
+    if (s->text > s->buf) {
+        s->bol = (s->text[-1] == '\n');    /* the byte is dropped */
+    }
+
+    if (keep >= s->size) {
+        int text_off = s->text - s->buf;
+        s->size *= 2;
+        s->own = s->buf = (char *)realloc(s->buf, s->size + 1);
+        if (s->buf == NULL) {
+            fprintf(stderr, "compact: not enough memory enlarging buffer\n");
+            exit(1);
+        }
+        s->text = s->buf + text_off;
+    }
+
+    if (s->text != s->buf) {
+        memmove(s->buf, s->text, keep);
+        s->base += s->text - s->buf;
+    }
+    s->text = s->cur = s->buf;
+    s->end = s->buf + keep;
+    *s->end = SENTINEL;
+}
+
+/* Read more input into the buffer after compacting it, *cp* and *last_cp*
+ * are adjusted accordingly. Return false if there is no more input. */
+static bool refill(scanner_t *s, char **cp, char **last_cp)
+{
+    int cp_off;     /* offsets of *cp* and *last_cp* in the token */
+    int last_off;
+    int n;
+
+    if (s->input == NULL || s->eof) {
+        return false;
+    }
+
+    cp_off = *cp - s->text;
+    last_off = *last_cp - s->text;
+    compact(s);
+    *cp = s->text + cp_off;
+    *last_cp = s->text + last_off;
+
+    n = s->input(s->end, s->size - (s->end - s->buf));
+    if (n <= 0) {
+        n = 0;
+        s->eof = true;
+    }
+
+    s->end += n;
+    *s->end = SENTINEL;
+
+    return n > 0;
+}
+
+/*----------------------------------------------------------------------------*/
+/* scan the caller's buffer in place instead of reading from input(). *buf*
+ * is not copied and must stay alive, buf[len] must be SENTINEL. */
+void zlex_scan_buffer(scanner_t *s, const char *buf, long len)
+{
+    if (buf[len] != SENTINEL) {
+        fprintf(stderr, "zlex_scan_buffer: buffer is not terminated by SENTINEL\n");
+        exit(1);
+    }
+
+    s->buf = s->cur = s->text = (char *)buf;
+    s->end = s->buf + len;
+    s->base = 0;
+    s->leng = 0;
+    s->eof = true;  /* never call input() on the caller's buffer */
+    if (s->lines != NULL) {
+        lines_clear(s->lines);
+    }
+    s->bol = true;
+    s->state = start_state(s, s->buf);
+    s->last_accept = F;
+    s->pos = s->last = s->buf;
+}
+
+/* scan the next token into *token*, return false at the end of input. */
+bool zlex_token(scanner_t *s, token_t *token)
+{
+    int state = zlex_scan(s);
+
+    if (state == SCAN_EOF) {
+        return false;
+    }
+
+    token->rule = s->rule;
+    token->offset = s->base + (s->text - s->buf);
+    token->len = s->leng;
+    return true;
+}
+
+/* copy the lexeme of *token* into *dst* as a '\0' terminated string, at most
+ * size-1 bytes are copied. Return *dst*, or NULL if the lexeme is no longer
+ * in the buffer. */
+char *zlex_lexeme(scanner_t *s, const token_t *token, char *dst, int size)
+{
+    long start = token->offset - s->base;
+    int len = token->len;
+
+    if (start < 0 || s->buf + start + len > s->end || size <= 0) {
+        return NULL;
+    }
+
+    if (len > size-1) {
+        len = size-1;
+    }
+    memcpy(dst, s->buf + start, len);
+    dst[len] = '\0';
+    return dst;
+}
+
+/* scan tokens of the caller's buffer into *out* until the buffer or the
+ * capacity *cap* runs out. Return the number of tokens stored, 0 when the
+ * buffer is exhausted. */
+int zlex_scan_batch(scanner_t *s, const char *buf, long len, batch_t *out,
+                    int cap)
+{
+    if (s->buf != buf) {
+        zlex_scan_buffer(s, buf, len);
+    }
+    return s->lex->backup ? scan_batch(s, buf, out, cap, true) :
+                            scan_batch(s, buf, out, cap, false);
+}
+
+/* zlex_scan_batch(), the last accept is only tracked if *backup* */
+static inline int scan_batch(scanner_t *s, const char *buf, batch_t *out,
+                             int cap, const bool backup)
+{
+    BYTE_ROW *trans = s->lex->trans;
+    ROW *dtrans = s->lex->dtrans;
+    accel_t *accel = s->lex->accel;
+    stride_t *stride = s->lex->stride;
+    int *rule = s->lex->rule;
+    int *nl_rule = s->lex->nl_rule;
+    const unsigned char *end;
+    const unsigned char *cp;
+    const unsigned char *text;
+    const unsigned char *last_cp;
+    int last_accept;
+    int state;
+    int next;
+    int pair;
+    int n;
+
+    end = (const unsigned char *)s->end;
+    cp = (const unsigned char *)s->cur;
+
+    for (n = 0; n < cap && cp < end; n++) {
+        text = last_cp = cp;
+        state = start_state(s, (const char *)cp);
+        last_accept = F;
+
+        for (;;) {
+            while ((next = trans[state][*cp]) != F) {
+                if (next == state && accel[state].nbytes != 0) {
+                    cp = (const unsigned char *)accel_skip(&accel[state],
+                            (const char *)cp + 1, (const char *)end);
+                } else if (stride != NULL &&
+                           (pair = STRIDE_NEXT(stride, state, cp)) != F) {
+                    if (backup && ACCEPTS(next, cp[1]) != F) {
+                        last_accept = next;
+                        last_cp = cp + 1;
+                    }
+                    state = pair;
+                    cp += 2;
+                } else {
+                    state = next;
+                    cp++;
+                }
+                if (backup && ACCEPTS(state, *cp) != F) {
+                    last_accept = state;
+                    last_cp = cp;
+                }
+            }
+
+            /* no refill here, only a NUL in the data goes on */
+            if (cp < end && *cp == SENTINEL &&
+                (next = dtrans[state][0]) != F) {
+                state = next;
+                cp++;
+                if (backup && ACCEPTS(state, *cp) != F) {
+                    last_accept = state;
+                    last_cp = cp;
+                }
+                continue;
+            }
+            break;
+        }
+
+        if (!backup && cp > text) {
+            last_accept = state;    /* every state entered by a transition */
+            last_cp = cp;
+        }
+        if (last_accept == F) {
+            last_cp = text + 1; /* no rule matches, skip a single byte */
+        }
+
+        out->rule[n] = (last_accept == F) ? F :
+                       ACCEPTS(last_accept, *last_cp);
+        if (last_accept != F) {
+            last_cp = (const unsigned char *)trail_end(s->lex, last_accept,
+                    out->rule[n], (const char *)text, (const char *)last_cp);
+        }
+        out->offset[n] = text - (const unsigned char *)buf;
+        out->len[n] = last_cp - text;
+        cp = last_cp;
+    }
+
+    s->cur = s->text = (char *)cp;
+    s->leng = 0;
+    return n;
+}
+
+/* a stream of zlex_scan_streams() */
+typedef struct lane
+{
+    const unsigned char *buf;
+    const unsigned char *end;
+    const unsigned char *cp;
+    const unsigned char *text;      /* start of the current token */
+    const unsigned char *last_cp;   /* end of the last accepted lexeme */
+    int last_accept;
+    int state;
+    batch_t *out;
+    int n;                          /* tokens stored */
+} lane_t;
+
+/* scan *k* independent buffers of the caller in lockstep. Return the total
+ * number of tokens stored. */
+int zlex_scan_streams(scanner_t *s, int k, const char *bufs[],
+                      const long lens[], long pos[], batch_t out[], int cap,
+                      int counts[])
+{
+    BYTE_ROW *trans = s->lex->trans;
+    ROW *dtrans = s->lex->dtrans;
+    int *rule = s->lex->rule;
+    int *nl_rule = s->lex->nl_rule;
+    int *bol = s->lex->bol;
+    lane_t lanes[MAX_STREAMS];
+    lane_t *lane;
+    int first;      /* first stream of the group */
+    int nlanes;
+    int active;
+    int total = 0;
+    int next;
+    int i;
+
+    for (first = 0; first < k; first += MAX_STREAMS) {
+        nlanes = (k - first < MAX_STREAMS) ? k - first : MAX_STREAMS;
+        active = 0;
+        for (i = 0; i < nlanes; i++) {
+            lane = &lanes[i];
+            if (bufs[first+i][lens[first+i]] != SENTINEL) {
+                fprintf(stderr, "zlex_scan_streams: buffer is not terminated by SENTINEL\n");
+                exit(1);
+            }
+            lane->buf = (const unsigned char *)bufs[first+i];
+            lane->end = lane->buf + lens[first+i];
+            lane->cp = lane->text = lane->last_cp = lane->buf + pos[first+i];
+            lane->last_accept = F;
+            lane->state = (lane->cp == lane->buf || lane->cp[-1] == '\n') ?
+                          bol[s->start] : s->start;
+            lane->out = &out[first+i];
+            lane->n = 0;
+            if (lane->cp < lane->end && cap > 0) {
+                active++;
+            } else {
+                lane->state = F;    /* nothing to do */
+            }
+        }
+
+        /* one transition of every active stream per round */
+        while (active > 0) {
+            for (i = 0; i < nlanes; i++) {
+                lane = &lanes[i];
+                if (lane->state == F) {
+                    continue;
+                }
+
+                next = trans[lane->state][*lane->cp];
+                if (next == F && lane->cp < lane->end &&
+                    *lane->cp == SENTINEL) {
+                    next = dtrans[lane->state][0];  /* a NUL in the data */
+                }
+                if (next != F) {
+                    lane->state = next;
+                    lane->cp++;
+                    if (ACCEPTS(next, *lane->cp) != F) {
+                        lane->last_accept = next;
+                        lane->last_cp = lane->cp;
+                    }
+                    continue;
+                }
+
+                /* jammed, the token is complete */
+                if (lane->last_accept == F) {
+                    lane->last_cp = lane->text + 1;
+                }
+                lane->out->rule[lane->n] = (lane->last_accept == F) ? F :
+                        ACCEPTS(lane->last_accept, *lane->last_cp);
+                if (lane->last_accept != F) {
+                    lane->last_cp = (const unsigned char *)trail_end(s->lex,
+                            lane->last_accept, lane->out->rule[lane->n],
+                            (const char *)lane->text,
+                            (const char *)lane->last_cp);
+                }
+                lane->out->offset[lane->n] = lane->text - lane->buf;
+                lane->out->len[lane->n] = lane->last_cp - lane->text;
+                lane->n++;
+
+                lane->cp = lane->text = lane->last_cp;
+                lane->last_accept = F;
+                lane->state = (lane->cp[-1] == '\n') ? bol[s->start] :
+                                                     s->start;
+                if (lane->cp == lane->end || lane->n == cap) {
+                    lane->state = F;
+                    active--;
+                }
+            }
+        }
+
+        for (i = 0; i < nlanes; i++) {
+            pos[first+i] = lanes[i].text - lanes[i].buf;
+            counts[first+i] = lanes[i].n;
+            total += lanes[i].n;
+        }
+    }
+
+    return total;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Push mode */
+
+/* feed a chunk of input to the scanner, *emit* is called for every token
+ * completed by the chunk. */
+void zlex_feed(scanner_t *s, const char *chunk, int len, emit_func emit,
+               void *arg)
+{
+    int pos_off;
+    int last_off;
+    int n;
+
+    while (len > 0) {
+        pos_off = s->pos - s->text;
+        last_off = s->last - s->text;
+        compact(s);
+        s->pos = s->text + pos_off;
+        s->last = s->text + last_off;
+
+        n = s->size - (s->end - s->buf);
+        if (n > len) {
+            n = len;
+        }
+        memcpy(s->end, chunk, n);
+        s->end += n;
+        *s->end = SENTINEL;
+        chunk += n;
+        len -= n;
+
+        push_scan(s, emit, arg, false);
+    }
+}
+
+/* tell the scanner that the input has ended, the pending token is completed
+ * and emitted. */
+void zlex_feed_end(scanner_t *s, emit_func emit, void *arg)
+{
+    push_scan(s, emit, arg, true);
+    s->eof = true;
+}
+
+/* Resume the DFA from the saved state of the pending token and emit every
+ * token completed in the buffer. The state is saved again when the data runs
+ * out, unless *at_eof* is true. */
+static void push_scan(scanner_t *s, emit_func emit, void *arg, bool at_eof)
+{
+    BYTE_ROW *trans = s->lex->trans;
+    accel_t *accel = s->lex->accel;
+    stride_t *stride = s->lex->stride;
+    int *rule = s->lex->rule;
+    int *nl_rule = s->lex->nl_rule;
+    char *cp = s->pos;
+    char *last_cp = s->last;
+    int last_accept = s->last_accept;
+    int state = s->state;
+    int next;
+    int pair;
+    token_t token;
+
+    if (cp > s->text && ACCEPTS(state, *cp) != F) {
+        last_accept = state;    /* the next byte was not fed yet */
+        last_cp = cp;
+    }
+
+    for (;;) {
+        while ((next = trans[state][(unsigned char)*cp]) != F) {
+            if (next == state && accel[state].nbytes != 0) {
+                cp = (char *)accel_skip(&accel[state], cp + 1, s->end);
+            } else if (stride != NULL && (pair = STRIDE_NEXT(stride, state,
+                       (unsigned char *)cp)) != F) {
+                if (ACCEPTS(next, cp[1]) != F) {  /* in the middle */
+                    last_accept = next;
+                    last_cp = cp + 1;
+                }
+                state = pair;
+                cp += 2;
+            } else {
+                state = next;
+                cp++;
+            }
+            if (ACCEPTS(state, *cp) != F) {
+                last_accept = state;
+                last_cp = cp;
+            }
+        }
+
+        if (cp < s->end && *cp == SENTINEL &&
+            (next = s->lex->dtrans[state][0]) != F) {
+            state = next;
+            cp++;
+            if (ACCEPTS(state, *cp) != F) {
+                last_accept = state;
+                last_cp = cp;
+            }
+            continue;
+        }
+
+        if (cp == s->end && (!at_eof || s->text == s->end)) {
+            break;  /* wait for more input */
+        }
+
+        /* the token is complete */
+        if (last_accept == F) {
+            last_cp = s->text + 1; /* no rule matches, skip a single byte */
+        }
+
+        token.rule = (last_accept == F) ? F : ACCEPTS(last_accept, *last_cp);
+        if (last_accept != F) {
+            last_cp = (char *)trail_end(s->lex, last_accept, token.rule,
+                                        s->text, last_cp);
+        }
+        s->rule = token.rule;
+        token.offset = s->base + (s->text - s->buf);
+        token.len = s->leng = last_cp - s->text;
+        emit(s, &token, arg);
+
+        s->text = s->cur = cp = last_cp;
+        state = start_state(s, cp);
+        last_accept = F;
+    }
+
+    s->pos = cp;
+    s->last = last_cp;
+    s->state = state;
+    s->last_accept = last_accept;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Line and column numbers */
+
+/* start tracking newlines */
+void zlex_track_lines(scanner_t *s)
+{
+    if (s->lines == NULL) {
+        s->lines = lines_new();
+    }
+}
+
+/* resolve an offset of the input into line and column numbers */
+void zlex_position(scanner_t *s, long offset, int *line, int *column)
+{
+    zlex_track_lines(s);
+    index_lines(s, offset);
+    lines_position(s->lines, offset, line, column);
+}
+
+/* index the newlines of the input up to offset *upto*, the bytes not yet
+ * indexed must still be in the buffer. */
+static void index_lines(scanner_t *s, long upto)
+{
+    long from = s->lines->indexed;
+
+    if (upto > s->base + (s->end - s->buf)) {
+        upto = s->base + (s->end - s->buf);
+    }
+    if (upto <= from) {
+        return;
+    }
+    if (from < s->base) {
+        fprintf(stderr, "index_lines: input dropped before it was indexed, "
+                "call zlex_track_lines() before scanning\n");
+        exit(1);
+    }
+
+    lines_index(s->lines, s->buf + (from - s->base), upto - from, from);
+}
+
+/*----------------------------------------------------------------------------*/
+/* The file is mapped on top of an anonymous mapping that is one byte longer
+ * than the file. The rest of the last page of a file mapping reads as zeros,
+ * the extra anonymous page covers the case that the size of the file is a
+ * multiple of the page size, so there is always a SENTINEL after the data. */
+static long map_size(long len)
+{
+    long page = sysconf(_SC_PAGESIZE);
+    return ((len + 1 + page - 1) / page) * page;
+}
+
+/* map a file into memory to be scanned by zlex_scan_buffer(). Return NULL if
+ * the file could not be mapped, *len* is set to the size of the file. */
+char *zlex_map(const char *path, long *len)
+{
+    struct stat st;
+    char *buf;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY)) < 0) {
+        return NULL;
+    }
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return NULL;
+    }
+
+    buf = mmap(NULL, map_size(st.st_size), PROT_READ,
+               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buf == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+
+    if (st.st_size > 0 && mmap(buf, st.st_size, PROT_READ,
+                               MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(buf, map_size(st.st_size));
+        close(fd);
+        return NULL;
+    }
+
+    close(fd);
+    *len = st.st_size;
+    return buf;
+}
+
+/* unmap a file mapped by zlex_map() */
+void zlex_unmap(char *buf, long len)
+{
+    munmap(buf, map_size(len));
+}
@@ -0,0 +1,244 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+/*-----------------------------------------------------------------------------
+ * scan.h -- the scanner runtime, drives the DFA transition table created by
+ * dfa() over an input stream.
+ *---------------------------------------------------------------------------*/
+#include <stdbool.h>
+#include "dfa.h"
+#include "lines.h"
+
+#define SENTINEL '\0'   /* end of buffer marker, always placed right after the
+                         * valid data in the buffer */
+#define MAX_BYTES 256   /* width of the runtime table: one column per byte */
+#define SCAN_BUF_SIZE 16384 /* default size of the input buffer */
+#define SCAN_EOF -2     /* returned by zlex_scan() at the end of input */
+
+typedef int BYTE_ROW[MAX_BYTES]; /* one row of the runtime table */
+
+#define MAX_ACCEL 4     /* max bytes recorded for an accelerated state */
+
+#define ZLEX_NO_ACCEL 1 /* zlex_compile_flags(): no state is accelerated */
+
+/* acceleration hint of a DFA state with a self loop */
+typedef struct accel
+{
+    int nbytes;         /* number of bytes recorded, 0 if not accelerated */
+    bool stay;          /* true if *bytes* are the ones that loop, otherwise
+                         * they are the ones that leave the state, along with
+                         * all bytes >= MAX_CHARS */
+    unsigned char bytes[MAX_ACCEL]; /* unused ones repeat bytes[0] */
+} accel_t;
+
+struct sheng;
+struct stride;
+
+/*----------------------------------------------------------------------------*/
+/* The compiled lexer: the tables a scanner runs on. It is never written
+ * after zlex_compile(), so any number of scanners in any threads could share
+ * it without locking. It is freed when the last reference is dropped. */
+typedef struct lexer
+{
+    BYTE_ROW *trans;    /* Dtrans widened to MAX_BYTES columns, the column of
+                         * SENTINEL is F in every state */
+    ROW *dtrans;        /* the original table, only consulted when a NUL is
+                         * found in the data */
+    accept_t *accept;   /* accepting states, indexed by state number */
+    int *rule;          /* rule number of each state, F if not accepting */
+    int *nl_rule;       /* rule number of each state when the next byte is a
+                         * newline, differs from *rule* for rules with $ */
+    int *bol;           /* start state at the beginning of a line instead of
+                         * each state, differs for conditions with ^ rules */
+    accel_t *accel;     /* acceleration hint of each state */
+    struct sheng *sheng; /* shuffle masks if the DFA is small enough, used
+                          * by zlex_match(), NULL otherwise */
+    struct stride *stride; /* table of two bytes per transition if it is
+                            * small enough, NULL otherwise */
+    int nstates;        /* number of DFA states */
+    int nconds;         /* number of start conditions, their start states are
+                         * 0 ... nconds-1 */
+    bool trail;         /* some rule has trailing context, see trail_end() */
+    bool backup;        /* some state could need backing up, otherwise the
+                         * last accept is not tracked, see backup.c */
+    int refs;           /* number of references, changed atomically */
+} lexer_t;
+
+/* A scanner is a cursor over a lexer: it only holds the input and where the
+ * DFA is in it, one per thread. */
+typedef struct scanner
+{
+    lexer_t *lex;       /* the tables, shared */
+
+    int (*input)(char *buf, int max); /* read at most *max* bytes into *buf*,
+                                       * return the number of bytes read, 0
+                                       * at the end of input */
+    char *buf;          /* input buffer, buf[size] is reserved for SENTINEL,
+                         * might be a buffer of the caller */
+    char *own;          /* the buffer allocated by the scanner */
+    int size;           /* size of the input buffer */
+    long base;          /* offset of buf[0] in the whole input */
+    char *cur;          /* where the next token starts */
+    char *end;          /* end of the valid data, *end == SENTINEL */
+    bool eof;           /* input() has reported the end of input */
+
+    char *text;         /* the last lexeme, it is NOT '\0' terminated */
+    int leng;           /* length of the last lexeme */
+    int rule;           /* rule number of the last lexeme, F if none */
+    char *jam;          /* where the DFA jammed while scanning the last
+                         * lexeme, bytes up to *jam were examined */
+    lines_t *lines;     /* newline index, NULL until positions are needed */
+    int start;          /* start state of the current start condition */
+    bool bol;           /* the byte before buf[0] is a newline, or buf[0] is
+                         * the beginning of input */
+
+    int state;          /* push mode: saved DFA state of the pending token */
+    int last_accept;    /* push mode: last accepting state of the pending
+                         * token, F if none */
+    char *pos;          /* push mode: where the DFA resumes */
+    char *last;         /* push mode: end of the last accepted lexeme */
+} scanner_t;
+
+/* A token is only a span of the input, the lexeme is not copied unless
+ * zlex_lexeme() is called. */
+typedef struct token
+{
+    int rule;           /* rule number of the token, F if no rule matches */
+    long offset;        /* offset of the lexeme in the input */
+    int len;            /* length of the lexeme */
+} token_t;
+
+/* Tokens in struct-of-arrays form filled by zlex_scan_batch(), the arrays
+ * are provided by the caller. */
+typedef struct batch
+{
+    int *rule;          /* rule numbers */
+    long *offset;       /* start offsets */
+    int *len;           /* lengths */
+} batch_t;
+
+/* called for every token completed in push mode, the lexeme is available to
+ * zlex_lexeme() during the call */
+typedef void (*emit_func)(scanner_t *scanner, const token_t *token, void *arg);
+
+/*----------------------------------------------------------------------------*/
+/* compile the tables returned by dfa()(or min_dfa()) into a lexer with one
+ * reference. *dtrans* and *accept* are not copied nor freed by the lexer.
+ * The start conditions are taken from dfa_conds(), so the tables should be
+ * the ones of the last DFA made. */
+lexer_t *zlex_compile(ROW *dtrans, accept_t *accept, int nstates);
+
+/* the same as zlex_compile(), *flags* turn off some of the speedups, e.g.
+ * ZLEX_NO_ACCEL, to compare with them */
+lexer_t *zlex_compile_flags(ROW *dtrans, accept_t *accept, int nstates,
+                            unsigned flags);
+
+/* take one more reference of the lexer, return *lex* */
+lexer_t *zlex_lexer_ref(lexer_t *lex);
+
+/* drop a reference of the lexer, it is freed with the last one */
+void zlex_lexer_unref(lexer_t *lex);
+
+/* create a scanner over a compiled lexer, the scanner takes a reference of
+ * it. *size* is the size of the input buffer, 0 for SCAN_BUF_SIZE. */
+scanner_t *zlex_cursor(lexer_t *lex, int (*input)(char *buf, int max),
+                       int size);
+
+/* create a scanner over the tables returned by dfa(), compiled for this
+ * scanner alone. The tables are not copied nor freed by the scanner. */
+scanner_t *zlex_open(ROW *dtrans, accept_t *accept, int nstates,
+                     int (*input)(char *buf, int max), int size);
+
+/* destory a scanner, and drop its reference of the lexer */
+void zlex_close(scanner_t *scanner);
+
+/* scan the next token with maximal munch. Return the accepting DFA state of
+ * the token, F if no rule matches (a single byte is consumed), or SCAN_EOF at
+ * the end of input. The lexeme is left in scanner->text and scanner->leng. */
+int zlex_scan(scanner_t *scanner);
+
+/* switch to start condition *cond*(numbered as by dfa_conds(), 0 is
+ * INITIAL), tokens from the next one on are scanned in that condition. It
+ * could be called between tokens, e.g. by the emit function in push mode. */
+void zlex_begin(scanner_t *scanner, int cond);
+
+/* run the DFA over the whole of *buf*(an anchored full match), return the
+ * rule number of the state it ends in, F if it is not accepting. Small DFAs
+ * are run by the shuffle based engine in sheng.c. */
+int zlex_match(const lexer_t *lex, const char *buf, long len);
+
+/*----------------------------------------------------------------------------*/
+/* Tokens as spans of the input */
+
+/* scan the caller's buffer in place instead of reading from input(). *buf*
+ * is not copied and must stay alive, buf[len] must be SENTINEL. */
+void zlex_scan_buffer(scanner_t *scanner, const char *buf, long len);
+
+/* scan the next token into *token*, return false at the end of input.
+ * The offset is relative to the caller's buffer in zlex_scan_buffer() mode,
+ * or to the beginning of the stream read by input(). */
+bool zlex_token(scanner_t *scanner, token_t *token);
+
+/* copy the lexeme of *token* into *dst* as a '\0' terminated string, at most
+ * size-1 bytes are copied. Return *dst*, or NULL if the lexeme is no longer
+ * in the buffer(only the last token is kept when reading from input()). */
+char *zlex_lexeme(scanner_t *scanner, const token_t *token, char *dst,
+                  int size);
+
+/* scan tokens of the caller's buffer into *out* until the buffer or the
+ * capacity *cap* runs out. Return the number of tokens stored, 0 when the
+ * buffer is exhausted. Calling it again with the same *buf* resumes from
+ * where the last call stopped, a different *buf* starts over as
+ * zlex_scan_buffer() does. buf[len] must be SENTINEL. */
+int zlex_scan_batch(scanner_t *scanner, const char *buf, long len,
+                    batch_t *out, int cap);
+
+#define MAX_STREAMS 8   /* streams advanced in lockstep by zlex_scan_streams() */
+
+/* scan *k* independent buffers of the caller in lockstep, one byte of every
+ * stream per round, so that the table lookups of different streams overlap.
+ * Every stream i starts at offset pos[i] of bufs[i] and its tokens are stored
+ * in out[i] until the buffer or the capacity *cap* runs out, counts[i] is set
+ * to the number of tokens stored and pos[i] to where the stream stopped, so
+ * calling it again resumes. A stream is finished when pos[i] == lens[i].
+ * Return the total number of tokens stored. bufs[i][lens[i]] must be
+ * SENTINEL. */
+int zlex_scan_streams(scanner_t *scanner, int k, const char *bufs[],
+                      const long lens[], long pos[], batch_t out[], int cap,
+                      int counts[]);
+
+/*----------------------------------------------------------------------------*/
+/* Push mode: the input is fed chunk by chunk instead of read by input().
+ * Open the scanner with a NULL input to use it. */
+
+/* feed a chunk of input to the scanner, *emit* is called for every token
+ * completed by the chunk. The chunk is not referenced after the call. */
+void zlex_feed(scanner_t *scanner, const char *chunk, int len, emit_func emit,
+               void *arg);
+
+/* tell the scanner that the input has ended, the pending token is completed
+ * and emitted. */
+void zlex_feed_end(scanner_t *scanner, emit_func emit, void *arg);
+
+/*----------------------------------------------------------------------------*/
+/* Line and column numbers, computed only when asked for */
+
+/* start tracking newlines. In zlex_scan_buffer() mode it is done the first
+ * time zlex_position() is called, when reading from input() it should be
+ * called before the first token as the buffer is reused. */
+void zlex_track_lines(scanner_t *scanner);
+
+/* resolve an offset of the input(e.g. token->offset) into line and column
+ * numbers, both start from 1. */
+void zlex_position(scanner_t *scanner, long offset, int *line, int *column);
+
+/*----------------------------------------------------------------------------*/
+/* map a file into memory to be scanned by zlex_scan_buffer(), the mapping
+ * is followed by at least one SENTINEL. Return NULL if the file could not be
+ * mapped, *len* is set to the size of the file. */
+char *zlex_map(const char *path, long *len);
+
+/* unmap a file mapped by zlex_map() */
+void zlex_unmap(char *buf, long len);
+
+#endif /* end of include guard: SCAN_H */
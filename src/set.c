@@ -209,10 +209,10 @@ set_t *set_dup(set_t *old_set)
     new_set->nbits = old_set->nbits;
 
     if (old_set->map == old_set->defmap) {
-        new_set->map = new_set->map;
+        new_set->map = new_set->defmap;
     } else {
         new_set->map = (_SETTYPE *)malloc(sizeof(_SETTYPE)* old_set->nwords);
-        if (new_set == NULL) {
+        if (new_set->map == NULL) {
             fprintf(stderr, "set_dup: not enough memory allocating set object\n");
             exit(1);
         }
@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_PSHUFB
+#endif
+
+#include "sheng.h"
+
+/*-----------------------------------------------------------------------------
+ * sheng.c -- shuffle based execution of small DFAs(the Sheng engine of
+ * Hyperscan)
+ *
+ * With at most 16 states, the transitions on one byte fit in a 16 byte
+ * vector: lane i holds the next state of state i. Keeping the current state
+ * in(every lane of) another vector, a single PSHUFB of the mask of the input
+ * byte by the state vector gives the next state:
+ *
+ *     state = _mm_shuffle_epi8(masks[c], state);
+ *
+ * So there is no dependent load from a large table, the masks of all bytes
+ * take only 4KB. PSHUFB needs SSSE3 which is not in the base line of x86-64,
+ * so it is selected at run time, the scalar version walks the same masks.
+ *---------------------------------------------------------------------------*/
+
+/* build the shuffle masks of a DFA, return NULL if it has more than
+ * SHENG_STATES-1 states. */
+sheng_t *sheng_new(ROW *dtrans, accept_t *accept, int nstates)
+{
+    sheng_t *sheng;
+    int state;
+    int next;
+    int c;
+
+    if (nstates > SHENG_STATES-1) {
+        return NULL;
+    }
+
+    sheng = (sheng_t *)aligned_alloc(16, sizeof(*sheng));
+    if (sheng == NULL) {
+        fprintf(stderr, "sheng_new: not enough memory allocating masks\n");
+        exit(1);
+    }
+
+    sheng->dead = nstates;
+    sheng->start = accept[0].bol;
+#ifdef HAVE_PSHUFB
+    sheng->pshufb = __builtin_cpu_supports("ssse3");
+#else
+    sheng->pshufb = false;
+#endif
+    for (state = 0; state < SHENG_STATES; state++) {
+        sheng->rule[state] = (state < nstates && accept[state].string) ?
+                             accept[state].rule : F;
+        for (c = 0; c < MAX_BYTES; c++) {
+            if (state >= nstates || c >= MAX_CHARS) {
+                next = F;
+            } else {
+                next = dtrans[state][c];
+            }
+            sheng->masks[c][state] = (next == F) ? sheng->dead : next;
+        }
+    }
+
+    return sheng;
+}
+
+/* destory the masks */
+void sheng_del(sheng_t *sheng)
+{
+    free(sheng);
+}
+
+/*----------------------------------------------------------------------------*/
+/* the same as sheng_match() in plain C */
+int sheng_match_scalar(const sheng_t *sheng, const char *buf, long len)
+{
+    const unsigned char *p = (const unsigned char *)buf;
+    const unsigned char *end = p + len;
+    unsigned state = sheng->start;
+
+    while (p < end) {
+        state = sheng->masks[*p++][state];
+    }
+    return sheng->rule[state];
+}
+
+#ifdef HAVE_PSHUFB
+__attribute__((target("ssse3")))
+static int match_pshufb(const sheng_t *sheng, const char *buf, long len)
+{
+    const unsigned char *p = (const unsigned char *)buf;
+    const unsigned char *end = p + len;
+    __m128i state = _mm_set1_epi8(sheng->start);
+
+    while (p < end) {
+        state = _mm_shuffle_epi8(
+                _mm_load_si128((const __m128i *)sheng->masks[*p++]), state);
+    }
+    return sheng->rule[_mm_cvtsi128_si32(state) & 0xFF];
+}
+#endif
+
+/* run the DFA over the whole of *buf*, return the rule number of the state
+ * it ends in, F if it is not accepting. */
+int sheng_match(const sheng_t *sheng, const char *buf, long len)
+{
+#ifdef HAVE_PSHUFB
+    if (sheng->pshufb) {
+        return match_pshufb(sheng, buf, len);
+    }
+#endif
+    return sheng_match_scalar(sheng, buf, len);
+}
@@ -0,0 +1,42 @@
+#ifndef SHENG_H
+#define SHENG_H
+
+/*-----------------------------------------------------------------------------
+ * sheng.h -- shuffle based execution of small DFAs
+ *---------------------------------------------------------------------------*/
+#include <stdbool.h>
+#include "dfa.h"
+#include "scan.h"
+
+#define SHENG_STATES 16 /* max states, including the failure state */
+
+typedef struct sheng
+{
+    /* masks[c][state]: next state on byte c, one 16 byte shuffle mask per
+     * byte. F is mapped to the state *dead*, which loops on every byte. */
+    unsigned char masks[MAX_BYTES][SHENG_STATES] __attribute__((aligned(16)));
+    int rule[SHENG_STATES]; /* rule number of each state, F if not accepting */
+    int dead;               /* the failure state */
+    int start;              /* the start state, INITIAL at the beginning of a
+                             * line */
+    bool pshufb;            /* the CPU supports PSHUFB, checked once so that
+                             * matching never writes to shared data */
+} sheng_t;
+
+/*----------------------------------------------------------------------------*/
+/* build the shuffle masks of a DFA, return NULL if it has more than
+ * SHENG_STATES-1 states. */
+sheng_t *sheng_new(ROW *dtrans, accept_t *accept, int nstates);
+
+/* destory the masks */
+void sheng_del(sheng_t *sheng);
+
+/* run the DFA over the whole of *buf*(an anchored full match), return the
+ * rule number of the state it ends in, F if it is not accepting. PSHUFB is
+ * used if the CPU supports it, otherwise sheng_match_scalar(). */
+int sheng_match(const sheng_t *sheng, const char *buf, long len);
+
+/* the same as sheng_match() in plain C */
+int sheng_match_scalar(const sheng_t *sheng, const char *buf, long len);
+
+#endif /* end of include guard: SHENG_H */
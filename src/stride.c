@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "stride.h"
+
+/*-----------------------------------------------------------------------------
+ * stride.c -- a DFA table that consumes two bytes per transition
+ *
+ * The inner loop of the scanner is bound by the latency of the chain of
+ * loads state -> trans[state][c] -> trans[next][c'] ..., one load per byte.
+ * The pair table looks up the state after two bytes at once, so the chain
+ * is only half as long. The state in the middle of the pair is looked up in
+ * the byte table at the same time, it is not on the chain, and it is what
+ * tells whether a lexeme is accepted in the middle of the pair.
+ *
+ * To keep the table small, the bytes are first grouped into equivalence
+ * classes: bytes whose columns are the same in every state. Most scanners
+ * have a few dozen classes at most, so a row of the pair table takes
+ * nclasses^2 entries instead of 65536. The table is not built at all if it
+ * would be larger than STRIDE_MAX_SIZE.
+ *---------------------------------------------------------------------------*/
+
+static bool same_column(BYTE_ROW *trans, int nstates, int a, int b);
+
+/*----------------------------------------------------------------------------*/
+/* build the pair table of the widened table of a scanner, return NULL if it
+ * would be larger than STRIDE_MAX_SIZE. */
+stride_t *stride_new(BYTE_ROW *trans, int nstates)
+{
+    stride_t *stride;
+    int first[MAX_BYTES];   /* first byte of each class */
+    int nclasses = 0;
+    int *pair;
+    int state;
+    int mid;
+    int a, b;
+    int c;
+
+    stride = (stride_t *)malloc(sizeof(*stride));
+    if (stride == NULL) {
+        fprintf(stderr, "stride_new: not enough memory\n");
+        exit(1);
+    }
+
+    for (c = 0; c < MAX_BYTES; c++) {
+        for (a = 0; a < nclasses; a++) {
+            if (same_column(trans, nstates, first[a], c)) {
+                break;
+            }
+        }
+        if (a == nclasses) {
+            first[nclasses++] = c;
+        }
+        stride->cls[c] = a;
+    }
+    stride->nclasses = nclasses;
+
+    if ((long)nstates * nclasses * nclasses * sizeof(int) > STRIDE_MAX_SIZE) {
+        free(stride);
+        return NULL;
+    }
+
+    stride->pairs = (int *)malloc(nstates * nclasses * nclasses * sizeof(int));
+    if (stride->pairs == NULL) {
+        fprintf(stderr, "stride_new: not enough memory allocating pairs\n");
+        exit(1);
+    }
+
+    pair = stride->pairs;
+    for (state = 0; state < nstates; state++) {
+        for (a = 0; a < nclasses; a++) {
+            mid = trans[state][first[a]];
+            for (b = 0; b < nclasses; b++) {
+                *pair++ = (mid == F) ? F : trans[mid][first[b]];
+            }
+        }
+    }
+
+    return stride;
+}
+
+/* destory the pair table */
+void stride_del(stride_t *stride)
+{
+    if (stride == NULL) {
+        return;
+    }
+    free(stride->pairs);
+    free(stride);
+}
+
+/* return true if bytes *a* and *b* go to the same state in every state */
+static bool same_column(BYTE_ROW *trans, int nstates, int a, int b)
+{
+    int state;
+
+    for (state = 0; state < nstates; state++) {
+        if (trans[state][a] != trans[state][b]) {
+            return false;
+        }
+    }
+    return true;
+}
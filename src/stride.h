@@ -0,0 +1,34 @@
+#ifndef STRIDE_H
+#define STRIDE_H
+
+/*-----------------------------------------------------------------------------
+ * stride.h -- a DFA table that consumes two bytes per transition
+ *---------------------------------------------------------------------------*/
+#include "scan.h"
+
+#define STRIDE_MAX_SIZE (256*1024) /* max size in bytes of the pair table,
+                                    * larger ones would not stay in cache */
+
+typedef struct stride
+{
+    unsigned char cls[MAX_BYTES]; /* equivalence class of each byte */
+    int nclasses;       /* number of classes */
+    int *pairs;         /* pairs[(state*nclasses + cls[a])*nclasses + cls[b]]:
+                         * the state after bytes *a* and *b*, F if the DFA
+                         * fails on either of them */
+} stride_t;
+
+/* the state after the two bytes at *cp* */
+#define STRIDE_NEXT(st, state, cp) \
+    ((st)->pairs[((state) * (st)->nclasses + (st)->cls[(cp)[0]]) * \
+                 (st)->nclasses + (st)->cls[(cp)[1]]])
+
+/*----------------------------------------------------------------------------*/
+/* build the pair table of the widened table of a scanner, return NULL if it
+ * would be larger than STRIDE_MAX_SIZE. */
+stride_t *stride_new(BYTE_ROW *trans, int nstates);
+
+/* destory the pair table */
+void stride_del(stride_t *stride);
+
+#endif /* end of include guard: STRIDE_H */
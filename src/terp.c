@@ -1,6 +1,9 @@
 /*-----------------------------------------------------------------------------
  * terp.c
  * Interpret NFA machines
+ *
+ * These are the set operations of the subset construction in dfa.c. To run
+ * an NFA without making a DFA, pike.c does it faster on a flat program.
  *----------------------------------------------------------------------------*/
 
 #include <stdio.h>
@@ -11,8 +14,7 @@
 #include "terp.h"
 
 /*----------------------------------------------------------------------------*/ 
-static nfa_t *NFA_states;
-static int max_states;
+static nfa_table_t *Table;  /* the machine in the compact layout */
 
 /* Compile the NFA and initialize the various global variables used by
  * move() and e_clsure(). Return the state number(index) of the NFA start
@@ -21,7 +23,11 @@ static int max_states;
 int nfa(char *(*input_func)(void))
 {
     nfa_t *start;
-    NFA_states = thompson(input_func, &start, &max_states);
+    nfa_t *states;
+    int max_states;
+
+    states = thompson(input_func, &start, &max_states);
+    Table = nfa_table(states, max_states);
 
     return start->nfa_id;
 }
@@ -29,6 +35,8 @@ int nfa(char *(*input_func)(void))
 
 void free_nfa(void)
 {
+    nfa_table_del(Table);
+    Table = NULL;
     destory_thompson();
 }
 
@@ -45,14 +53,15 @@ set_t *e_closure(set_t *old, char **accept, anchor_t *anchor)
 {
     int stack[MAX_NFA_STATES];  /* stack of untested states */
     int *top = stack-1;         /* stack pointer */
-    nfa_t *run = NULL;          /* the current running NFA state */
     int i;                      /* state number of */
+    int k;                      /* index in the accepting states */
     int accept_num = INT_MAX;
         
     if (old == NULL) {
         goto exit;
     }
     *accept = NULL;
+    *anchor = NONE;
 
     /* push all states into stack */
     for (set_next_member(NULL); (i = set_next_member(old)) >= 0; ) {
@@ -62,28 +71,25 @@ set_t *e_closure(set_t *old, char **accept, anchor_t *anchor)
     while (top >= stack) {
         i = *top--;
 
-        run = &NFA_states[i];
-        if (run->accept && (i < accept_num)) {
+        if ((Table->flags[i] & NFA_ACCEPT) && (i < accept_num)) {
+            k = nfa_table_accept(Table, i);
             accept_num = i;
-            *accept = run->accept;
-            *anchor = run->anchor;
+            *accept = Table->accept[k];
+            *anchor = Table->anchor[k];
         }
 
-        if (run->edge == EPSILON) {
-            if (run->next1) {
-                i = run->next1->nfa_id;
-                if (!set_is_member(old, i)) {
-                    set_add(old, i);
-                    *++top = i;
-                }
+        if (Table->label[i] == EPSILON) {
+            int next1 = Table->next1[i];
+            int next2 = Table->next2[i];
+
+            if (next1 >= 0 && !set_is_member(old, next1)) {
+                set_add(old, next1);
+                *++top = next1;
             }
 
-            if (run->next2) {
-                i = run->next2->nfa_id;
-                if (!set_is_member(old, i)) {
-                    set_add(old, i);
-                    *++top = i;
-                }
+            if (next2 >= 0 && !set_is_member(old, next2)) {
+                set_add(old, next2);
+                *++top = next2;
             }
         }
     }
@@ -92,25 +98,58 @@ exit:
     return old;
 }
 
+/* *accept* is set to the accepting string of the highest priority(the lowest
+ * state number) in *set* that is not anchored at the end of line, NULL if
+ * none. *eol* is set to the one of the highest priority among all if it is
+ * anchored at the end of line, i.e. the one taken before a newline, NULL
+ * otherwise. */
+void accepts(set_t *set, char **accept, char **eol)
+{
+    int accept_num = INT_MAX;
+    int eol_num = INT_MAX;
+    int i;
+    int k;
+
+    *accept = *eol = NULL;
+    for (set_next_member(NULL); (i = set_next_member(set)) >= 0; ) {
+        if ((k = nfa_table_accept(Table, i)) < 0) {
+            continue;
+        }
+        if (!(Table->anchor[k] & END) && i < accept_num) {
+            accept_num = i;
+            *accept = Table->accept[k];
+        } else if ((Table->anchor[k] & END) && i < eol_num) {
+            eol_num = i;
+            *eol = Table->accept[k];
+        }
+    }
+
+    if (eol_num > accept_num) {
+        *eol = NULL;    /* overridden by a rule without anchor */
+    }
+}
+
 /* return a set that contains all NFA states that can be reached by making
  * transitions on *c* from any NFA state in *old*, returns NULL if there's no
  * such transitios, the *old* set is not modified. */
 set_t *move(set_t *old, int c)
 {
     int i; 
-    nfa_t *run = NULL; /* current NFA state. */
+    int label;  /* label of the current NFA state */
+    int in;     /* *c* as seen by the state */
     set_t *output = NULL; /* output set */
+    int fc = FOLD(c);  /* *c* as seen by the case-insensitive states */
 
+    for (set_next_member(NULL); (i = set_next_member(old)) >= 0; ) {
+        label = Table->label[i];
+        in = (Table->flags[i] & NFA_FOLD) ? fc : c;
 
-    for (set_next_member(NULL); (i=set_next_member(old) >= 0); ) {
-        run = &NFA_states[i];
-
-        if (run->edge == c ||
-            (run->edge == CCL && set_is_member(run->bitset, c))) {
+        if (label == in || (IS_CCL(label) &&
+            set_is_member(Table->ccls[CCL_INDEX(label)], in))) {
             if (output == NULL) {
                 output = set_new();
             }
-            set_add(output, run->next1->nfa_id);
+            set_add(output, Table->next1[i]);
         }
     }
 
@@ -12,5 +12,6 @@ int nfa(char *(*input_func)(void));
 void free_nfa(void);
 set_t *e_closure(set_t *old, char **accept, anchor_t *anchor);
 set_t *move(set_t *old, int c);
+void accepts(set_t *set, char **accept, char **eol);
 
 #endif /* TERP_H */
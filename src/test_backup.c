@@ -0,0 +1,157 @@
+/* test_backup.c
+ * Test the backing up analysis: the report of a spec that backs up, and the
+ * scanner without last accept tracking on a spec that does not, which should
+ * give the same tokens as the one with it. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "dfa.h"
+#include "scan.h"
+#include "backup.h"
+#include "check.h"
+
+/* "ab" is not accepted, the scanner backs up to "a" on "abx" */
+char *backup_rules[] = {
+    "a A",
+    "abc ABC",
+    "[0-9]+ NUM",
+    "[\\s]+",
+    NULL,
+};
+
+char *free_rules[] = {
+    "if KW",
+    "[a-z]+ ID",
+    "[0-9]+ NUM",
+    "[\\s]+",
+    NULL,
+};
+
+/* the start state at the beginning of a line is the state of "^a*" as
+ * well, min_dfa() merges them */
+char *bol_rules[] = {
+    "^a*b X",
+    NULL,
+};
+
+char **line;
+
+char *get_expr(void)
+{
+    line++;
+    return *line;
+}
+
+
+/* the scanner without last accept tracking, *arg*[0], and the one with it
+ * should give the same tokens, by zlex_token() and zlex_scan_batch() */
+static bool same_tokens(char *buf, int len, void *arg)
+{
+    scanner_t *fast = ((scanner_t **)arg)[0];
+    scanner_t *slow = ((scanner_t **)arg)[1];
+    token_t a, b;
+    batch_t batch;
+    int rules[64];
+    long offsets[64];
+    int lens[64];
+    bool same = true;
+    int j, n;
+
+    zlex_scan_buffer(fast, buf, len);
+    zlex_scan_buffer(slow, buf, len);
+    while (zlex_token(fast, &a)) {
+        if (!zlex_token(slow, &b) || a.rule != b.rule ||
+            a.offset != b.offset || a.len != b.len) {
+            return false;
+        }
+    }
+    if (zlex_token(slow, &b)) {
+        return false;
+    }
+
+    batch.rule = rules;
+    batch.offset = offsets;
+    batch.len = lens;
+    zlex_scan_buffer(fast, buf, len);
+    zlex_scan_buffer(slow, buf, len);
+    n = zlex_scan_batch(fast, buf, len, &batch, 64);
+    for (j = 0; j < n && zlex_token(slow, &b); j++) {
+        if (rules[j] != b.rule || offsets[j] != b.offset ||
+            lens[j] != b.len) {
+            same = false;
+        }
+    }
+    return same && j == n && !zlex_token(slow, &b);
+}
+
+/* write the report of the spec into *buf*, return the number of states */
+static int report(char **rules, char *buf, int size)
+{
+    ROW *dtrans;
+    accept_t *accept;
+    int nstates;
+    int nbackup;
+    FILE *fp = tmpfile();
+
+    line = rules-1;
+    nstates = min_dfa(get_expr, &dtrans, &accept);
+    nbackup = dfa_backup(dtrans, accept, nstates, fp);
+
+    rewind(fp);
+    buf[fread(buf, 1, size-1, fp)] = '\0';
+    fclose(fp);
+    free(dtrans);
+    free(accept);
+    return nbackup;
+}
+
+int main(int argc, char *argv[])
+{
+    ROW *dtrans;
+    accept_t *accept;
+    int nstates;
+    scanner_t *fast;
+    scanner_t *slow;
+    scanner_t *both[2];
+    token_t a;
+    char text[1024];
+
+    check("one state backs up", report(backup_rules, text, sizeof(text)) == 1
+          && strstr(text, "is non-accepting") != NULL
+          && strstr(text, "associated rule line numbers:\n\t2\n") != NULL
+          && strstr(text, " out-transitions: [ c ]") != NULL);
+    check("backup-free", report(free_rules, text, sizeof(text)) == 0 &&
+          strcmp(text, "No backing up.\n") == 0);
+    check("merged start state backs up",
+          report(bol_rules, text, sizeof(text)) == 1);
+
+    line = bol_rules-1;
+    nstates = min_dfa(get_expr, &dtrans, &accept);
+    fast = zlex_open(dtrans, accept, nstates, NULL, 0);
+    zlex_scan_buffer(fast, "aac", 3);
+    check("backing up from a merged start state", fast->lex->backup &&
+          zlex_token(fast, &a) && a.rule == F && a.len == 1 &&
+          zlex_token(fast, &a) && a.rule == F && a.len == 1 &&
+          zlex_token(fast, &a) && a.rule == F && a.len == 1 &&
+          !zlex_token(fast, &a));
+    zlex_close(fast);
+    free(dtrans);
+    free(accept);
+
+    line = free_rules-1;
+    nstates = dfa(get_expr, &dtrans, &accept);
+    fast = zlex_open(dtrans, accept, nstates, NULL, 0);
+    slow = zlex_open(dtrans, accept, nstates, NULL, 0);
+    check("no last accept tracking", !fast->lex->backup);
+    slow->lex->backup = true;
+
+    both[0] = fast;
+    both[1] = slow;
+    random_strings("random buffers", "abcfi09 \n\x80", 63, 10000, 7,
+                   same_tokens, both);
+
+    zlex_close(fast);
+    zlex_close(slow);
+    return Errors ? 1 : 0;
+}
@@ -0,0 +1,88 @@
+/* test_classify.c
+ * Test classifying many strings by a pool of threads: the results should be
+ * the same as matching the strings one by one. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dfa.h"
+#include "scan.h"
+#include "classify.h"
+
+char *rules[] = {
+    "[0-9]+ INT",
+    "[0-9]+\\.[0-9]+ FLOAT",
+    "(http|https):\\/\\/[a-z.]+(\\/[a-z]*)* URL",
+    "[a-z]+ WORD",
+    NULL,
+};
+
+char **line = rules-1;
+
+char *get_expr(void)
+{
+    line++;
+    return *line;
+}
+
+#define N 100000
+
+static const char *Words[] = {
+    "123", "4.5", "http://a.b/c/", "https://x.org", "word", "", "1.", "a1",
+    "ftp://x", "http://", "9.99", "https://a/b/c",
+};
+
+int main(int argc, char *argv[])
+{
+    ROW *dtrans;
+    accept_t *accept;
+    int nstates;
+    lexer_t *lex;
+    classify_t *classify;
+    const char **strings;
+    int *out;
+    int *want;
+    int errors = 0;
+    long n;
+    long i;
+
+    nstates = dfa(get_expr, &dtrans, &accept);
+    lex = zlex_compile(dtrans, accept, nstates);
+    classify = zlex_classify_new(lex, 4);
+
+    strings = (const char **)malloc(N * sizeof(*strings));
+    out = (int *)malloc(N * sizeof(*out));
+    want = (int *)malloc(N * sizeof(*want));
+    for (i = 0; i < N; i++) {
+        strings[i] = Words[rand() % (sizeof(Words)/sizeof(Words[0]))];
+        want[i] = zlex_match(lex, strings[i], strlen(strings[i]));
+    }
+
+    printf(">>> rules of the words --- %s\n",
+           zlex_match(lex, "123", 3) == 0 &&
+           zlex_match(lex, "4.5", 3) == 1 &&
+           zlex_match(lex, "http://a.b/c/", 13) == 2 &&
+           zlex_match(lex, "word", 4) == 3 &&
+           zlex_match(lex, "ftp://x", 7) == F ? "OK" : "Error");
+
+    /* jobs of different sizes, run by the caller alone or by the pool */
+    for (n = 1; n <= N; n *= 10) {
+        memset(out, 0xff, N * sizeof(*out));
+        zlex_classify_many(classify, strings, n, out);
+        for (i = 0; i < n; i++) {
+            if (out[i] != want[i]) {
+                break;
+            }
+        }
+        printf(">>> %ld strings --- %s\n", n, i == n ? "OK" : "Error");
+        if (i != n) {
+            errors++;
+        }
+    }
+
+    zlex_classify_del(classify);
+    zlex_lexer_unref(lex);
+    free(strings);
+    free(out);
+    free(want);
+    return errors ? 1 : 0;
+}
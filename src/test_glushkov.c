@@ -0,0 +1,178 @@
+/* test_glushkov.c
+ * Test the bit-parallel position automaton: full matches should be the same
+ * as the DFA's, and a search should find the first end of a match of the
+ * DFA in any substring. Then the cases of its own: classes of
+ * case-insensitive terms, a rule matching the empty string and the limit of
+ * positions. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dfa.h"
+#include "scan.h"
+#include "glushkov.h"
+#include "check.h"
+
+char *rules[] = {
+    "[0-9]+ INT",
+    "[0-9]+\\.[0-9]+ FLOAT",
+    "(?i:if|of) KW",
+    "[a-z]+ WORD",
+    "a(b|c)*d? ABCD",
+    "x{2,3} XX",
+    NULL,
+};
+
+/* classes of case-insensitive terms, and a rule matching the empty string */
+char *caseless[] = {
+    "(?i:[a-c]x) ABC",
+    "(?i:[^a-z0-9]) OTHER",
+    "(?i:k)* KS",
+    NULL,
+};
+
+/* rules the engine does not take */
+char *anchored[] = {
+    "^abc ABC",
+    NULL,
+};
+
+char **line;
+
+char *get_expr(void)
+{
+    line++;
+    return *line;
+}
+
+/* the first end of a match in *buf*, by the DFA on every substring */
+static long search(const lexer_t *lex, const char *buf, int len, int *rule)
+{
+    int end, start, r;
+
+    for (end = 1; end <= len; end++) {
+        *rule = F;
+        for (start = 0; start < end; start++) {
+            r = zlex_match(lex, buf + start, end - start);
+            if (r != F && (*rule == F || r < *rule)) {
+                *rule = r;
+            }
+        }
+        if (*rule != F) {
+            return end;
+        }
+    }
+    return -1;
+}
+
+typedef struct engines
+{
+    glushkov_t *g;
+    lexer_t *lex;
+} engines_t;
+
+/* a full match, and the first match anywhere */
+static bool agree(char *buf, int len, void *arg)
+{
+    engines_t *e = (engines_t *)arg;
+    int rule, want_rule;
+    long end, want_end;
+
+    if (glushkov_match(e->g, buf, len) != zlex_match(e->lex, buf, len)) {
+        return false;
+    }
+    want_end = search(e->lex, buf, len, &want_rule);
+    end = glushkov_search(e->g, buf, len, &rule);
+    return end == want_end && (end < 0 || rule == want_rule);
+}
+
+/* build the automaton of *rules*, and the DFA as the reference */
+static glushkov_t *build(char **rules, lexer_t **lex, ROW **dtrans,
+                         accept_t **accept)
+{
+    glushkov_t *g;
+    int nstates;
+
+    line = rules-1;
+    g = glushkov_new(get_expr);
+    line = rules-1;
+    nstates = dfa(get_expr, dtrans, accept);
+    *lex = zlex_compile(*dtrans, *accept, nstates);
+    return g;
+}
+
+static void release(glushkov_t *g, lexer_t *lex, ROW *dtrans,
+                    accept_t *accept)
+{
+    glushkov_del(g);
+    zlex_lexer_unref(lex);
+    free(dtrans);
+    free(accept);
+}
+
+/* a literal of *n* characters is *n* positions */
+static glushkov_t *literal(int n, char *text)
+{
+    char *spec[2];
+    int i;
+
+    for (i = 0; i < n; i++) {
+        text[i] = 'a' + i % 26;
+    }
+    strcpy(text + n, " LONG");
+    spec[0] = text;
+    spec[1] = NULL;
+    line = spec-1;
+    return glushkov_new(get_expr);
+}
+
+int main(int argc, char *argv[])
+{
+    ROW *dtrans;
+    accept_t *accept;
+    lexer_t *lex;
+    glushkov_t *g;
+    engines_t e;
+    char text[GLUSHKOV_POSITIONS + 16];
+    int rule;
+
+    g = build(rules, &lex, &dtrans, &accept);
+    check("built", g != NULL);
+    if (g == NULL) {
+        return 1;
+    }
+    e.g = g;
+    e.lex = lex;
+    random_strings("random strings", "09.ifoIFabcdxz\x80", 16, 10000, 46,
+                   agree, &e);
+    release(g, lex, dtrans, accept);
+
+    /* folded classes, negated ones exclude both cases */
+    g = build(caseless, &lex, &dtrans, &accept);
+    check("case-insensitive classes", g != NULL &&
+          glushkov_match(g, "Bx", 2) == 0 && glushkov_match(g, "cX", 2) == 0 &&
+          glushkov_match(g, "Q", 1) == F && glushkov_match(g, "#", 1) == 1 &&
+          zlex_match(lex, "Bx", 2) == 0 && zlex_match(lex, "Q", 1) == F);
+
+    /* "(?i:k)*" matches the empty string: at the start of any buffer */
+    check("empty match", g->empty == 2 && glushkov_match(g, "", 0) == 2 &&
+          glushkov_search(g, "xyz", 3, &rule) == 0 && rule == 2 &&
+          glushkov_match(g, "kK", 2) == 2);
+    release(g, lex, dtrans, accept);
+
+    /* at most GLUSHKOV_POSITIONS, the last one is the top bit */
+    g = literal(GLUSHKOV_POSITIONS, text);
+    check("positions up to the limit", g != NULL &&
+          g->npos == GLUSHKOV_POSITIONS &&
+          glushkov_match(g, text, GLUSHKOV_POSITIONS) == 0 &&
+          glushkov_match(g, text, GLUSHKOV_POSITIONS - 1) == F &&
+          glushkov_search(g, text, GLUSHKOV_POSITIONS, &rule) ==
+          GLUSHKOV_POSITIONS);
+    glushkov_del(g);
+    check("too many positions",
+          literal(GLUSHKOV_POSITIONS + 1, text) == NULL);
+
+    line = anchored-1;
+    check("anchors rejected", glushkov_new(get_expr) == NULL);
+
+    return Errors ? 1 : 0;
+}
@@ -0,0 +1,54 @@
+/* test_lines.c
+ * Test the newline index: the input is indexed in pieces of random sizes and
+ * every offset is resolved and compared with a plain count. */
+#include <stdio.h>
+#include <stdlib.h>
+#include "lines.h"
+
+#define LEN 5000
+
+static char Buf[LEN];
+
+int main(int argc, char *argv[])
+{
+    lines_t *lines = lines_new();
+    long i, n;
+    int line, column;
+    int want_line = 1, want_column = 1;
+    int errors = 0;
+
+    srand(31);
+    for (i = 0; i < LEN; i++) {
+        Buf[i] = (rand() % 7 == 0) ? '\n' : 'a' + rand() % 26;
+    }
+
+    for (i = 0; i < LEN; i += n) {
+        n = rand() % 40;
+        if (i + n > LEN) {
+            n = LEN - i;
+        }
+        lines_index(lines, Buf + i, n, i);
+    }
+
+    for (i = 0; i < LEN; i++) {
+        lines_position(lines, i, &line, &column);
+        if (line != want_line || column != want_column) {
+            printf("offset %ld: expected %d:%d, got %d:%d --- Error\n", i,
+                   want_line, want_column, line, column);
+            errors++;
+        }
+
+        if (Buf[i] == '\n') {
+            want_line++;
+            want_column = 1;
+        } else {
+            want_column++;
+        }
+    }
+
+    printf(">>> %d lines indexed --- %s\n", lines->n + 1,
+           errors == 0 && lines->indexed == LEN ? "OK" : "Error");
+
+    lines_del(lines);
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,153 @@
+/* test_pike.c
+ * Test the Pike VM: full matches should be the same as the DFA's, and so
+ * should the longest match at the beginning of a buffer. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "dfa.h"
+#include "scan.h"
+#include "pike.h"
+#include "check.h"
+
+char *rules[] = {
+    "%x STR",
+    "[0-9]+ INT",
+    "[0-9]+\\.[0-9]+ FLOAT",
+    "(?i:if|of) KW",
+    "^#[a-z]+ DIR",
+    "[a-z]+ WORD",
+    "[a-c]{2,3}x ABX",
+    "o[^a-z0-9]+ ODD",
+    "<STR>[^.]+ TEXT",
+    NULL,
+};
+
+char **line;
+
+char *get_expr(void)
+{
+    line++;
+    return *line;
+}
+
+typedef struct engines
+{
+    pike_t *pike;
+    pike_scratch_t *scratch;
+    lexer_t *lex;
+} engines_t;
+
+/* a full match, and the longest prefix the DFA accepts */
+static bool agree(char *buf, int len, void *arg)
+{
+    engines_t *e = (engines_t *)arg;
+    int rule, want_rule;
+    long n, want;
+
+    if (pike_match(e->pike, e->scratch, buf, len) !=
+        zlex_match(e->lex, buf, len)) {
+        return false;
+    }
+    for (want = len; want >= 0; want--) {
+        if ((want_rule = zlex_match(e->lex, buf, want)) != F) {
+            break;
+        }
+    }
+    n = pike_scan(e->pike, e->scratch, 0, true, buf, len, &rule);
+    return n == want && (n < 0 || rule == want_rule);
+}
+
+/* scan the same program in another thread with scratch space of its own */
+static void *run(void *arg)
+{
+    engines_t e = *(engines_t *)arg;
+    bool *ok = (bool *)malloc(sizeof(bool));
+    int i;
+
+    e.scratch = pike_scratch_new(e.pike);
+    *ok = true;
+    for (i = 0; i < 1000; i++) {
+        *ok = *ok && agree("12.5", 4, &e) && agree("ofIF", 4, &e) &&
+              agree("abcx", 4, &e);
+    }
+    pike_scratch_del(e.scratch);
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    ROW *dtrans;
+    accept_t *accept;
+    int nstates;
+    lexer_t *lex;
+    pike_t *pike;
+    pike_scratch_t *scratch;
+    engines_t e;
+    pthread_t threads[2];
+    bool *ok[2];
+    pike_t *again;
+    char **strings;
+    bool kept;
+    int rule;
+    int i;
+
+    line = rules-1;
+    pike = pike_new(get_expr);
+    line = rules-1;
+    nstates = dfa(get_expr, &dtrans, &accept);
+    lex = zlex_compile(dtrans, accept, nstates);
+    check("compiled", pike != NULL);
+    if (pike == NULL) {
+        return 1;
+    }
+
+    scratch = pike_scratch_new(pike);
+    e.pike = pike;
+    e.scratch = scratch;
+    e.lex = lex;
+    random_strings("random strings", "09.ifoIF#abcxz\x80", 16, 10000, 47,
+                   agree, &e);
+
+    check("start conditions",
+          pike_scan(pike, scratch, 1, false, "ab#cd.ef", 8, &rule) == 5 &&
+          rule == 7 &&
+          pike_scan(pike, scratch, 0, false, "#ab", 3, &rule) < 0 &&
+          pike_scan(pike, scratch, 0, true, "#ab", 3, &rule) == 3 &&
+          rule == 3);
+
+    pthread_create(&threads[0], NULL, run, &e);
+    pthread_create(&threads[1], NULL, run, &e);
+    pthread_join(threads[0], (void **)&ok[0]);
+    pthread_join(threads[1], (void **)&ok[1]);
+    check("one program in two threads", *ok[0] && *ok[1]);
+    free(ok[0]);
+    free(ok[1]);
+
+    /* a new program frees its own accepting strings, not the DFA's */
+    strings = (char **)malloc(nstates * sizeof(char *));
+    for (i = 0; i < nstates; i++) {
+        strings[i] = accept[i].string ? strdup(accept[i].string) : NULL;
+    }
+    line = rules-1;
+    again = pike_new(get_expr);
+    line = rules-1;
+    pike_del(pike_new(get_expr));
+    kept = again != NULL && again->ninst == pike->ninst;
+    for (i = 0; i < nstates; i++) {
+        kept = kept && (strings[i] == NULL ? accept[i].string == NULL :
+                        strcmp(strings[i], accept[i].string) == 0 &&
+                        ACCEPT_RULE(accept[i].string) == accept[i].rule);
+        free(strings[i]);
+    }
+    check("accepting strings kept", kept);
+    free(strings);
+    pike_del(again);
+
+    pike_scratch_del(scratch);
+    pike_del(pike);
+    zlex_lexer_unref(lex);
+    free(dtrans);
+    free(accept);
+    return Errors ? 1 : 0;
+}
@@ -0,0 +1,138 @@
+/* test_relex.c
+ * Test incremental re-lexing: after every random edit the token stream
+ * should be the same as the one of a full scan of the edited buffer. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "dfa.h"
+#include "scan.h"
+#include "relex.h"
+#include "check.h"
+
+char *rules[] = {
+    "^a+ LEAD",     /* depends on the byte before the token */
+    "b+$ LAST",     /* depends on the byte after the token */
+    "[0-9]+ NUM",
+    "x+y XY",   /* needs backing up on "xxx" */
+    "x X",
+    "[a-wz]+ ID",
+    "[\\s\\n]+",
+    NULL,
+};
+
+char **line = rules-1;
+
+char *get_expr(void)
+{
+    line++;
+    return *line;
+}
+
+#define MAX_TEXT 4096
+#define EDITS 500
+
+static char Text[MAX_TEXT];
+static const char Alphabet[] = "abxy 12\n";
+
+/* compare the tokens with a full scan of the buffer */
+static bool same_as_full_scan(scanner_t *scanner, relex_t *relex, long len)
+{
+    relex_t *full = zlex_relex_new(scanner, Text, len);
+    bool same = full->ntokens == relex->ntokens;
+    int i;
+
+    for (i = 0; same && i < full->ntokens; i++) {
+        same = full->tokens[i].rule == relex->tokens[i].rule &&
+               full->tokens[i].offset == relex->tokens[i].offset &&
+               full->tokens[i].len == relex->tokens[i].len;
+    }
+    zlex_relex_del(full);
+    return same;
+}
+
+/* delete *removed* bytes at *offset*, re-lex and compare with a full scan */
+static bool delete(scanner_t *scanner, relex_t *relex, long *len,
+                   long offset, long removed)
+{
+    int nold, nnew;
+
+    memmove(Text + offset, Text + offset + removed,
+            *len - offset - removed + 1);
+    *len -= removed;
+    zlex_relex(relex, Text, *len, offset, removed, 0, &nold, &nnew);
+    return same_as_full_scan(scanner, relex, *len);
+}
+
+int main(int argc, char *argv[])
+{
+    ROW *dtrans;
+    accept_t *accept;
+    int nstates;
+    scanner_t *scanner;
+    relex_t *relex;
+    long len;
+    long offset, removed, inserted;
+    int nold, nnew;
+    int changed = 0;
+    int errors = 0;
+    int i, j;
+
+    nstates = dfa(get_expr, &dtrans, &accept);
+    scanner = zlex_open(dtrans, accept, nstates, NULL, 0);
+
+    srand(26);
+    for (len = 0; len < 2000; len++) {
+        Text[len] = Alphabet[rand() % (sizeof(Alphabet)-1)];
+    }
+    Text[len] = SENTINEL;
+    relex = zlex_relex_new(scanner, Text, len);
+
+    for (i = 0; i < EDITS; i++) {
+        offset = rand() % (len + 1);
+        removed = rand() % 4;
+        if (offset + removed > len) {
+            removed = len - offset;
+        }
+        inserted = rand() % 4;
+
+        memmove(Text + offset + inserted, Text + offset + removed,
+                len - offset - removed + 1);
+        for (j = 0; j < inserted; j++) {
+            Text[offset + j] = Alphabet[rand() % (sizeof(Alphabet)-1)];
+        }
+        len += inserted - removed;
+
+        zlex_relex(relex, Text, len, offset, removed, inserted, &nold, &nnew);
+        changed += nnew;
+
+        if (!same_as_full_scan(scanner, relex, len)) {
+            printf("Edit %d at %ld --- Error\n", i, offset);
+            errors++;
+        }
+    }
+
+    printf(">>> %d edits re-lexed --- %s\n", EDITS, errors ? "Error" : "OK");
+    printf(">>> %d tokens scanned again, %d tokens in all --- %s\n", changed,
+           relex->ntokens, changed < EDITS * 10 ? "OK" : "Error");
+
+    /* edits that remove the end of the buffer, where the new tokens never
+     * get in sync with the old ones */
+    check("tail deleted", delete(scanner, relex, &len, len - 5, 5) &&
+          delete(scanner, relex, &len, len - 1, 1));
+    check("whole buffer deleted", delete(scanner, relex, &len, 0, len) &&
+          relex->ntokens == 0 && delete(scanner, relex, &len, 0, 0));
+    zlex_relex_del(relex);
+
+    /* a token for every byte: deleting both of "ab" leaves none */
+    strcpy(Text, "ab");
+    Text[2] = SENTINEL;
+    len = 2;
+    relex = zlex_relex_new(scanner, Text, len);
+    check("tokens behind the edit replaced",
+          delete(scanner, relex, &len, 0, 2) && relex->ntokens == 0);
+
+    zlex_relex_del(relex);
+    zlex_close(scanner);
+    return errors || Errors ? 1 : 0;
+}
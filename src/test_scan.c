@@ -0,0 +1,1032 @@
+/* test_scan.c
+ * Test the scanner runtime over the tables created by dfa(). A tiny buffer
+ * and tiny reads are used so that tokens cross the buffer boundary. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "dfa.h"
+#include "scan.h"
+#include "check.h"
+#include "pike.h"
+#include "glushkov.h"
+
+char *rules[] = {
+    "[0-9]+ NUM",
+    "[a-z_][a-z0-9_]* ID",
+    "[\\s\\t\\n]+",
+    NULL,
+};
+
+/* a spec with states worth accelerating */
+char *comment_rules[] = {
+    "\\/\\*[^*]*\\*\\/ COMMENT",
+    "[\\s\\t\\n]+",
+    "[a-z]+ ID",
+    NULL,
+};
+
+/* a spec with start conditions: text in quotes is scanned in STR */
+char *cond_rules[] = {
+    "%x STR",
+    "%s ANY",
+    "' QUOTE",
+    "[a-z]+ ID",
+    "[\\s]+",
+    "<STR>' QUOTE",
+    "<STR>[^'@]+ TEXT",
+    "<*>@ AT",
+    NULL,
+};
+
+/* a spec with anchors: ^ and $ look at the bytes around the lexeme */
+char *anchor_rules[] = {
+    "^#[a-z]+ DIR",
+    "[a-z]+$ LAST",
+    "[a-z#]+ WORD",
+    "[\\s\\n]+",
+    NULL,
+};
+
+/* a spec with trailing context: of fixed length, after a part of fixed
+ * length and of variable length after a part of variable length */
+char *trail_rules[] = {
+    "if/\\( KW",
+    "[0-9]+/\\.\\. INT",
+    "x[a-z0-9]*/[0-9]+= VAR",
+    "[0-9]+ NUM",
+    "[a-z]+ ID",
+    "[\\.\\(\\)=\\s]",
+    NULL,
+};
+
+/* a spec with counted repetitions */
+char *repeat_rules[] = {
+    "a{3} A3",
+    "b{2,4} B24",
+    "c{2,} C2",
+    "(de){0,2}f DEF",
+    "[0-9]{4}/\\- YEAR",
+    NULL,
+};
+
+char *caseless_rules[] = {
+    "(?i:select) SELECT",
+    "(?i:x[^y]) XNY",
+    "[a-z]+ ID",
+    "(?i:q)(?-i:q) QQ",
+    NULL,
+};
+
+char *global_rules[] = {
+    "%option case-insensitive",
+    "if IF",
+    "[a-z]+ ID",
+    NULL,
+};
+
+/* rules sharing literal prefixes, merged into a trie by the NFA parser */
+char *trie_rules[] = {
+    "%x STR",
+    "^ifdef IFDEF",
+    "if IF",
+    "int INT",
+    "in IN",
+    "i[a-z]* ID_I",
+    "(?i:if) CASE_IF",
+    "[a-z]+ ID",
+    "<STR>in STR_IN",
+    "<STR>i[a-z]* STR_ID",
+    "<*>[\\s]+",
+    NULL,
+};
+
+/* keywords sharing their action, and a rule of the same action as the
+ * first but a lower priority than the one between */
+char *shared_rules[] = {
+    "%option shared-actions",
+    "if return KW;",
+    "ab Y",
+    "do return KW;",
+    "a[b] return KW;",
+    "[a-z]+x ID",
+    NULL,
+};
+
+char **line = rules-1;
+
+char *get_expr(void)
+{
+    line++;
+    return *line;
+}
+
+static char *Input = "abc 12 verylongidentifier_x\n7 # q0";
+static char *pInput;
+
+/* read at most 3 bytes at a time */
+int read_input(char *buf, int max)
+{
+    int n = strlen(pInput);
+    if (n > 3) {
+        n = 3;
+    }
+    if (n > max) {
+        n = max;
+    }
+    memcpy(buf, pInput, n);
+    pInput += n;
+    return n;
+}
+
+char *expected[] = {
+    "ID:abc", ":\x20", "NUM:12", ":\x20", "ID:verylongidentifier_x", ":\n",
+    "NUM:7", ":\x20", "#", ":\x20", "ID:q0", NULL,
+};
+
+/* scan the input read by read_input() through a tiny buffer */
+static void test_stream(ROW *dtrans, accept_t *accept, int nstates)
+{
+    scanner_t *scanner;
+    char got[128];
+    int state;
+    int line, column;
+    long last = 0;
+    int i = 0;
+
+    pInput = Input;
+    scanner = zlex_open(dtrans, accept, nstates, read_input, 8);
+    zlex_track_lines(scanner);
+
+    while ((state = zlex_scan(scanner)) != SCAN_EOF) {
+        last = scanner->base + (scanner->text - scanner->buf);
+        if (state == F) {
+            sprintf(got, "%.*s", scanner->leng, scanner->text);
+        } else {
+            sprintf(got, "%s:%.*s", accept[state].string, scanner->leng,
+                    scanner->text);
+        }
+
+        if (expected[i] == NULL || strcmp(got, expected[i]) != 0) {
+            printf("Case %d: Expected '%s', got '%s' --- Error\n", i,
+                   expected[i] ? expected[i] : "EOF", got);
+            Errors++;
+        } else {
+            printf("Case %d: OK\n", i);
+        }
+        if (expected[i] != NULL) {
+            i++;
+        }
+    }
+
+    check("all tokens scanned", expected[i] == NULL);
+
+    /* "q0" is the last token */
+    zlex_position(scanner, last, &line, &column);
+    check("position of the last token", line == 2 && column == 5);
+    zlex_close(scanner);
+}
+
+/* scan spans of a buffer, only the identifiers are copied out */
+static void scan_spans(scanner_t *scanner, const char *buf)
+{
+    token_t token;
+    char lexeme[128];
+    char ids[128] = "";
+    long offset = 0;
+    int line, column;
+    int n = 0;
+
+    while (zlex_token(scanner, &token)) {
+        if (token.offset != offset) {
+            break;
+        }
+        offset += token.len;
+        n++;
+
+        if (token.rule == 1) {
+            strcat(ids, zlex_lexeme(scanner, &token, lexeme, sizeof(lexeme)));
+            strcat(ids, ",");
+        }
+    }
+
+    check("spans cover the input", offset == (long)strlen(buf) && n == 11);
+    check("identifiers", strcmp(ids, "abc,verylongidentifier_x,q0,") == 0);
+
+    zlex_position(scanner, strchr(buf, '#') - buf, &line, &column);
+    check("position of #", line == 2 && column == 3);
+}
+
+static void test_buffer(ROW *dtrans, accept_t *accept, int nstates)
+{
+    scanner_t *scanner;
+    char path[] = "/tmp/test_scanXXXXXX";
+    char *map;
+    long len;
+    int fd;
+
+    scanner = zlex_open(dtrans, accept, nstates, NULL, 0);
+    zlex_scan_buffer(scanner, Input, strlen(Input));
+    scan_spans(scanner, Input);
+
+    /* the same input from a mapped file */
+    fd = mkstemp(path);
+    write(fd, Input, strlen(Input));
+    close(fd);
+
+    map = zlex_map(path, &len);
+    check("map file", map != NULL && len == strlen(Input));
+    zlex_scan_buffer(scanner, map, len);
+    scan_spans(scanner, Input);
+
+    zlex_unmap(map, len);
+    unlink(path);
+    zlex_close(scanner);
+}
+
+/* tokens of a batch should be the same as the ones from zlex_token() */
+static void test_batch(ROW *dtrans, accept_t *accept, int nstates)
+{
+    scanner_t *scanner;
+    scanner_t *batch;
+    token_t token;
+    int rule[4];
+    long offset[4];
+    int len[4];
+    batch_t out = {rule, offset, len};
+    bool same = true;
+    int calls = 0;
+    int n;
+    int i;
+
+    scanner = zlex_open(dtrans, accept, nstates, NULL, 0);
+    zlex_scan_buffer(scanner, Input, strlen(Input));
+    token.rule = F;
+
+    /* a fresh scanner for the batches, resumed on every call */
+    batch = zlex_open(dtrans, accept, nstates, NULL, 0);
+    while ((n = zlex_scan_batch(batch, Input, strlen(Input), &out, 4)) > 0) {
+        calls++;
+        for (i = 0; i < n; i++) {
+            if (!zlex_token(scanner, &token) || token.rule != rule[i] ||
+                token.offset != offset[i] || token.len != len[i]) {
+                same = false;
+            }
+        }
+    }
+
+    check("batch same as single tokens", same && !zlex_token(scanner, &token));
+    check("batch resumed", calls == 3);
+
+    zlex_close(batch);
+    zlex_close(scanner);
+}
+
+/* tokens of every stream should be the same as scanning it alone */
+static void test_streams(ROW *dtrans, accept_t *accept, int nstates)
+{
+    static const char *inputs[] = {
+        "abc 12", "", "x", "7 # q0", "a\n\nb", "  ", "verylongidentifier_x",
+        "1 2 3 4 5 6 7", "#", "z9",
+    };
+    enum { K = sizeof(inputs)/sizeof(inputs[0]), CAP = 3 };
+    scanner_t *scanner;
+    scanner_t *single;
+    token_t token;
+    long lens[K];
+    long pos[K] = {0};
+    int counts[K];
+    int rule[K][CAP];
+    long offset[K][CAP];
+    int len[K][CAP];
+    batch_t out[K];
+    char got[K][256];   /* tokens of each stream as a string */
+    bool same = true;
+    int rounds = 0;
+    int i, j;
+
+    scanner = zlex_open(dtrans, accept, nstates, NULL, 0);
+    single = zlex_open(dtrans, accept, nstates, NULL, 0);
+    for (i = 0; i < K; i++) {
+        lens[i] = strlen(inputs[i]);
+        out[i].rule = rule[i];
+        out[i].offset = offset[i];
+        out[i].len = len[i];
+    }
+
+    memset(got, 0, sizeof(got));
+    while (zlex_scan_streams(scanner, K, inputs, lens, pos, out, CAP,
+                             counts) > 0) {
+        rounds++;
+        for (i = 0; i < K; i++) {
+            for (j = 0; j < counts[i]; j++) {
+                sprintf(got[i] + strlen(got[i]), "%d:%ld:%d,", rule[i][j],
+                        offset[i][j], len[i][j]);
+            }
+        }
+    }
+
+    for (i = 0; i < K; i++) {
+        char expect[256] = "";
+
+        zlex_scan_buffer(single, inputs[i], lens[i]);
+        while (zlex_token(single, &token)) {
+            sprintf(expect + strlen(expect), "%d:%ld:%d,", token.rule,
+                    token.offset, token.len);
+        }
+        if (strcmp(got[i], expect) != 0 || pos[i] != lens[i]) {
+            printf("stream %d: got %s, expected %s\n", i, got[i], expect);
+            same = false;
+        }
+    }
+
+    check("streams same as single scans", same);
+    check("streams resumed", rounds == 5);
+
+    zlex_close(single);
+    zlex_close(scanner);
+}
+
+/* collect the tokens of push mode as strings */
+static void collect(scanner_t *scanner, const token_t *token, void *arg)
+{
+    char *got = (char *)arg;
+    char lexeme[128];
+
+    zlex_lexeme(scanner, token, lexeme, sizeof(lexeme));
+    sprintf(got + strlen(got), "%d<%s>", token->rule, lexeme);
+}
+
+/* feed the input in chunks of every size from 1 to 9 bytes */
+static void test_push(ROW *dtrans, accept_t *accept, int nstates)
+{
+    scanner_t *scanner;
+    char expect[512] = "";
+    char got[512];
+    token_t token;
+    int chunk;
+    int len = strlen(Input);
+    int i;
+    bool ok = true;
+
+    scanner = zlex_open(dtrans, accept, nstates, NULL, 0);
+    zlex_scan_buffer(scanner, Input, len);
+    while (zlex_token(scanner, &token)) {
+        collect(scanner, &token, expect);
+    }
+    zlex_close(scanner);
+
+    for (chunk = 1; chunk < 10; chunk++) {
+        scanner = zlex_open(dtrans, accept, nstates, NULL, 8);
+        got[0] = '\0';
+        for (i = 0; i < len; i += chunk) {
+            zlex_feed(scanner, Input + i, (len-i < chunk) ? len-i : chunk,
+                      collect, got);
+        }
+        zlex_feed_end(scanner, collect, got);
+        if (strcmp(got, expect) != 0) {
+            printf("chunk %d: got %s\n", chunk, got);
+            ok = false;
+        }
+        zlex_close(scanner);
+    }
+
+    check("push mode same as buffer mode", ok);
+}
+
+/* scan Input with a cursor of its own, return the tokens as a string */
+static void *scan_thread(void *arg)
+{
+    lexer_t *lex = (lexer_t *)arg;
+    scanner_t *scanner;
+    token_t token;
+    char *got;
+    int i;
+
+    got = (char *)calloc(1, 512);
+    scanner = zlex_cursor(lex, NULL, 0);
+    for (i = 0; i < 1000; i++) {
+        got[0] = '\0';
+        zlex_scan_buffer(scanner, Input, strlen(Input));
+        while (zlex_token(scanner, &token)) {
+            sprintf(got + strlen(got), "%d:%ld,", token.rule, token.offset);
+        }
+    }
+    zlex_close(scanner);
+    return got;
+}
+
+/* one compiled lexer shared by cursors in several threads */
+static void test_threads(ROW *dtrans, accept_t *accept, int nstates)
+{
+    lexer_t *lex;
+    pthread_t threads[4];
+    char *got[4];
+    bool same = true;
+    int i;
+
+    lex = zlex_compile(dtrans, accept, nstates);
+    for (i = 0; i < 4; i++) {
+        pthread_create(&threads[i], NULL, scan_thread, lex);
+    }
+    for (i = 0; i < 4; i++) {
+        pthread_join(threads[i], (void **)&got[i]);
+        if (strcmp(got[i], got[0]) != 0 || strlen(got[i]) == 0) {
+            same = false;
+        }
+    }
+
+    check("cursors in threads", same);
+    check("references dropped", lex->refs == 1);
+
+    for (i = 0; i < 4; i++) {
+        free(got[i]);
+    }
+    zlex_lexer_unref(lex);
+}
+
+/* switch between start conditions on quotes */
+static void test_conds(void)
+{
+    ROW *dtrans;
+    accept_t *accept;
+    int nstates;
+    int nconds;
+    char **names;
+    scanner_t *scanner;
+    token_t token;
+    char got[256] = "";
+    char lexeme[64];
+    char *buf = "ab 'cd ef@' @gh";
+
+    line = cond_rules-1;
+    nstates = min_dfa(get_expr, &dtrans, &accept);
+    nconds = dfa_conds(&names);
+    check("start conditions", nconds == 3 && strcmp(names[0], "INITIAL") == 0
+          && strcmp(names[1], "STR") == 0 && strcmp(names[2], "ANY") == 0);
+
+    scanner = zlex_open(dtrans, accept, nstates, NULL, 0);
+    zlex_scan_buffer(scanner, buf, strlen(buf));
+    while (zlex_token(scanner, &token)) {
+        sprintf(got + strlen(got), "%d<%s>", token.rule,
+                zlex_lexeme(scanner, &token, lexeme, sizeof(lexeme)));
+        if (token.rule == 0) {
+            zlex_begin(scanner, 1);
+        } else if (token.rule == 3) {
+            zlex_begin(scanner, 0);
+        }
+    }
+    check("tokens in start conditions", strcmp(got,
+          "1<ab>2< >0<'>4<cd ef>5<@>3<'>2< >5<@>1<gh>") == 0);
+
+    /* the inclusive condition takes the rules without prefix */
+    zlex_begin(scanner, 2);
+    zlex_scan_buffer(scanner, "ab", 2);
+    check("inclusive condition", zlex_token(scanner, &token) &&
+          token.rule == 1 && token.len == 2);
+
+    /* zlex_begin() takes no more conditions than the spec has */
+    check("conditions of the lexer", scanner->lex->nconds == nconds &&
+          nconds == 3 && scanner->lex->nstates > nconds);
+
+    zlex_close(scanner);
+}
+
+/* collect only the rule numbers of push mode */
+static void collect_rule(scanner_t *scanner, const token_t *token, void *arg)
+{
+    char *got = (char *)arg;
+
+    sprintf(got + strlen(got), "%d,", token->rule);
+}
+
+/* ^ and $ in buffer, read and push modes, tokens cross the tiny buffer */
+static void test_anchors(void)
+{
+    ROW *dtrans;
+    accept_t *accept;
+    int nstates;
+    scanner_t *scanner;
+    token_t token;
+    char *buf = "#def ab #x cd\n#y ef\nend";
+    char *expect = "0,3,2,3,2,3,1,3,0,3,1,3,2,";
+    char got[128] = "";
+    int len = strlen(buf);
+    int chunk;
+    int i;
+    bool ok = true;
+
+    line = anchor_rules-1;
+    nstates = min_dfa(get_expr, &dtrans, &accept);
+
+    scanner = zlex_open(dtrans, accept, nstates, NULL, 0);
+    zlex_scan_buffer(scanner, buf, len);
+    while (zlex_token(scanner, &token)) {
+        sprintf(got + strlen(got), "%d,", token.rule);
+    }
+    zlex_close(scanner);
+    check("anchored tokens", strcmp(got, expect) == 0);
+
+    pInput = buf;
+    got[0] = '\0';
+    scanner = zlex_open(dtrans, accept, nstates, read_input, 8);
+    while (zlex_token(scanner, &token)) {
+        sprintf(got + strlen(got), "%d,", token.rule);
+    }
+    zlex_close(scanner);
+    check("anchored tokens read from input", strcmp(got, expect) == 0);
+
+    for (chunk = 1; chunk < 10; chunk++) {
+        scanner = zlex_open(dtrans, accept, nstates, NULL, 8);
+        got[0] = '\0';
+        for (i = 0; i < len; i += chunk) {
+            zlex_feed(scanner, buf + i, (len-i < chunk) ? len-i : chunk,
+                      collect_rule, got);
+        }
+        zlex_feed_end(scanner, collect_rule, got);
+        if (strcmp(got, expect) != 0) {
+            printf("chunk %d: got %s\n", chunk, got);
+            ok = false;
+        }
+        zlex_close(scanner);
+    }
+    check("anchored tokens in push mode", ok);
+
+    free(dtrans);
+    free(accept);
+}
+
+/* only the part before the trailing context is the lexeme */
+static void test_trail(void)
+{
+    ROW *dtrans;
+    accept_t *accept;
+    int nstates;
+    scanner_t *scanner;
+    token_t token;
+    batch_t batch;
+    int rules[32];
+    long offsets[32];
+    int lens[32];
+    char *buf = "if(x) 1..2 xab12=3 if x12 5.";
+    char *expect = "0<if>5<(>4<x>5<)>5< >1<1>5<.>5<.>3<2>5< >2<xab1>3<2>"
+                   "5<=>3<3>5< >4<if>5< >4<x>3<12>5< >3<5>5<.>";
+    char got[256] = "";
+    int len = strlen(buf);
+    int chunk;
+    int i, n;
+    bool ok = true;
+
+    line = trail_rules-1;
+    nstates = min_dfa(get_expr, &dtrans, &accept);
+    for (i = 0; i < nstates; i++) {
+        if ((accept[i].rule == 0 && accept[i].head != 2) ||
+            (accept[i].rule == 1 && (accept[i].head != -1 ||
+                                     accept[i].tail != 2)) ||
+            (accept[i].rule == 2 && accept[i].head_start == F)) {
+            ok = false;
+        }
+    }
+    check("lengths of trailing context", ok);
+
+    scanner = zlex_open(dtrans, accept, nstates, NULL, 0);
+    zlex_scan_buffer(scanner, buf, len);
+    while (zlex_token(scanner, &token)) {
+        collect(scanner, &token, got);
+    }
+    check("tokens with trailing context", strcmp(got, expect) == 0);
+
+    batch.rule = rules;
+    batch.offset = offsets;
+    batch.len = lens;
+    zlex_scan_buffer(scanner, buf, len);
+    n = zlex_scan_batch(scanner, buf, len, &batch, 32);
+    zlex_scan_buffer(scanner, buf, len);
+    for (i = 0; i < n && zlex_token(scanner, &token); i++) {
+        if (rules[i] != token.rule || offsets[i] != token.offset ||
+            lens[i] != token.len) {
+            break;
+        }
+    }
+    check("batch with trailing context", i == n && !zlex_token(scanner,
+                                                               &token));
+    zlex_close(scanner);
+
+    ok = true;
+    for (chunk = 1; chunk < 10; chunk++) {
+        scanner = zlex_open(dtrans, accept, nstates, NULL, 8);
+        got[0] = '\0';
+        for (i = 0; i < len; i += chunk) {
+            zlex_feed(scanner, buf + i, (len-i < chunk) ? len-i : chunk,
+                      collect, got);
+        }
+        zlex_feed_end(scanner, collect, got);
+        if (strcmp(got, expect) != 0) {
+            printf("chunk %d: got %s\n", chunk, got);
+            ok = false;
+        }
+        zlex_close(scanner);
+    }
+    check("trailing context in push mode", ok);
+
+    free(dtrans);
+    free(accept);
+}
+
+/* whole strings matched by counted repetitions */
+static void test_repeat(void)
+{
+    ROW *dtrans;
+    accept_t *accept;
+    int nstates;
+    lexer_t *lex;
+    static const struct {
+        char *str;
+        int rule;
+    } cases[] = {
+        {"aaa", 0}, {"aa", F}, {"aaaa", F},
+        {"bb", 1}, {"bbb", 1}, {"bbbb", 1}, {"b", F}, {"bbbbb", F},
+        {"cc", 2}, {"cccccc", 2}, {"c", F},
+        {"f", 3}, {"def", 3}, {"dedef", 3}, {"dededef", F}, {"ddef", F},
+    };
+    bool ok = true;
+    int i;
+
+    line = repeat_rules-1;
+    nstates = min_dfa(get_expr, &dtrans, &accept);
+    lex = zlex_compile(dtrans, accept, nstates);
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        if (zlex_match(lex, cases[i].str, strlen(cases[i].str)) !=
+            cases[i].rule) {
+            printf("%s: got %d\n", cases[i].str,
+                   zlex_match(lex, cases[i].str, strlen(cases[i].str)));
+            ok = false;
+        }
+    }
+    check("counted repetitions", ok);
+
+    for (i = 0; i < nstates && (accept[i].rule != 4 ||
+                                accept[i].head == 4); i++) {
+        /* pass */
+    }
+    check("repetition of fixed length", i == nstates);
+
+    zlex_lexer_unref(lex);
+    free(dtrans);
+    free(accept);
+}
+
+static void test_caseless(void)
+{
+    ROW *dtrans;
+    accept_t *accept;
+    int nstates;
+    int plain;
+    lexer_t *lex;
+    static const struct {
+        char *str;
+        int rule;
+    } cases[] = {
+        {"select", 0}, {"SELECT", 0}, {"SeLeCt", 0},
+        {"xa", 1}, {"XA", 1}, {"X1", 1}, {"xy", 2}, {"XY", F}, {"xY", F},
+        {"abc", 2}, {"ABC", F}, {"Qq", 3}, {"QQ", F},
+    };
+    bool ok = true;
+    int i;
+
+    line = caseless_rules-1;
+    nstates = min_dfa(get_expr, &dtrans, &accept);
+    lex = zlex_compile(dtrans, accept, nstates);
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        if (zlex_match(lex, cases[i].str, strlen(cases[i].str)) !=
+            cases[i].rule) {
+            printf("%s: got %d\n", cases[i].str,
+                   zlex_match(lex, cases[i].str, strlen(cases[i].str)));
+            ok = false;
+        }
+    }
+    check("case-insensitive terms", ok);
+    zlex_lexer_unref(lex);
+    free(dtrans);
+    free(accept);
+
+    /* the same number of states with or without the option */
+    line = global_rules;
+    plain = min_dfa(get_expr, &dtrans, &accept);
+    free(dtrans);
+    free(accept);
+
+    line = global_rules-1;
+    nstates = min_dfa(get_expr, &dtrans, &accept);
+    lex = zlex_compile(dtrans, accept, nstates);
+    check("case-insensitive option", nstates == plain &&
+          zlex_match(lex, "IF", 2) == 0 && zlex_match(lex, "iF", 2) == 0 &&
+          zlex_match(lex, "Foo", 3) == 1);
+    zlex_lexer_unref(lex);
+    free(dtrans);
+    free(accept);
+}
+
+/* the priority of the rules and their conditions survive the trie */
+static void test_trie(void)
+{
+    ROW *dtrans;
+    accept_t *accept;
+    int nstates;
+    scanner_t *scanner;
+    token_t token;
+    char got[256] = "";
+    char *buf = "ifdef ifdef int in i If x";
+
+    line = trie_rules-1;
+    nstates = min_dfa(get_expr, &dtrans, &accept);
+    scanner = zlex_open(dtrans, accept, nstates, NULL, 0);
+    zlex_scan_buffer(scanner, buf, strlen(buf));
+    while (zlex_token(scanner, &token)) {
+        if (token.rule != 9) {
+            sprintf(got + strlen(got), "%d,", token.rule);
+        }
+    }
+    check("priority of merged prefixes", strcmp(got, "0,4,2,3,4,5,6,") == 0);
+
+    zlex_begin(scanner, 1);
+    zlex_scan_buffer(scanner, "in int if", 9);
+    got[0] = '\0';
+    while (zlex_token(scanner, &token)) {
+        if (token.rule != 9) {
+            sprintf(got + strlen(got), "%d,", token.rule);
+        }
+    }
+    check("merged prefixes in conditions", strcmp(got, "7,8,8,") == 0);
+
+    zlex_close(scanner);
+    free(dtrans);
+    free(accept);
+}
+
+/* no state of the NFA is a link or unreachable after the compaction, and
+ * the accepting states are still in the order of the rules */
+static void test_compact(void)
+{
+    nfa_t *states;
+    nfa_table_t *table;
+    set_t **ccls;
+    int ccls_az = -1;
+    nfa_t *start;
+    nfa_t **starts;
+    nfa_t **bol_starts;
+    nfa_t *p;
+    nfa_t *stack[MAX_NFA_STATES];
+    bool seen[MAX_NFA_STATES] = {false};
+    int max_state;
+    int top = 0;
+    int nseen = 0;
+    int rule = 0;
+    bool ok = true;
+    int nconds;
+    int i;
+
+#define PUSH(p) do {                                    \
+        if ((p) != NULL && !seen[(p)->nfa_id]) {        \
+            seen[(p)->nfa_id] = true;                   \
+            stack[top++] = (p);                         \
+        }                                               \
+    } while (0)
+
+    line = trie_rules-1;
+    states = thompson(get_expr, &start, &max_state);
+    nconds = thompson_conds(&starts, &bol_starts, NULL);
+    for (i = 0; i < nconds; i++) {
+        PUSH(starts[i]);
+        PUSH(bol_starts[i]);
+    }
+    while (top > 0) {
+        p = stack[--top];
+        nseen++;
+        PUSH(p->next1);
+        PUSH(p->next2);
+    }
+
+#undef PUSH
+    for (i = 0; i < max_state; i++) {
+        p = states[i].next1;
+        if (p != NULL && p->edge == EPSILON && p->next2 == NULL &&
+            p->accept == NULL && p->next1 != NULL) {
+            ok = false;
+        }
+        if (states[i].accept != NULL) {
+            ok = ok && ACCEPT_RULE(states[i].accept) >= rule;
+            rule = ACCEPT_RULE(states[i].accept);
+        }
+    }
+    check("compact NFA", ok && nseen == max_state && rule == 9 &&
+          start == bol_starts[0]);
+
+    /* [a-z] is in four rules, [\s] in one */
+    table = nfa_table(states, max_state);
+    ok = table->nstates == max_state && table->naccepts == 10 &&
+         table->nccls == 2 && thompson_ccls(&ccls) == 2 &&
+         table->ccls == ccls;
+    for (i = 0; i < max_state; i++) {
+        ok = ok && table->next1[i] == (states[i].next1 ?
+                                       states[i].next1->nfa_id : -1) &&
+             (nfa_table_accept(table, i) < 0 ? states[i].accept == NULL :
+              table->accept[nfa_table_accept(table, i)] == states[i].accept);
+    }
+    check("compact layout", ok);
+    nfa_table_del(table);
+
+    /* the four [a-z] share one set */
+    ok = thompson_ccls(&ccls) == 2;
+    for (i = 0; i < max_state; i++) {
+        if (states[i].edge == CCL) {
+            if (ccls_az < 0 && set_is_member(states[i].bitset, 'a')) {
+                ccls_az = states[i].ccl;
+            }
+            ok = ok && states[i].bitset == ccls[states[i].ccl] &&
+                 (set_is_member(states[i].bitset, 'a') ?
+                  states[i].ccl == ccls_az : states[i].ccl != ccls_az);
+        }
+    }
+    check("interned classes", ok && ccls_az >= 0);
+
+    destory_thompson();
+}
+
+/* accelerated scanning should be the same as the plain one */
+static void test_accel(void)
+{
+    ROW *dtrans;
+    accept_t *accept;
+    int nstates;
+    lexer_t *lex;
+    scanner_t *fast;
+    scanner_t *slow;
+    token_t a, b;
+    char *buf;
+    int accelerated = 0;
+    bool plain = true;  /* no state of *slow* is accelerated */
+    int len = 0;
+    int i;
+    bool same = true;
+
+    line = comment_rules-1;
+    nstates = dfa(get_expr, &dtrans, &accept);
+
+    buf = (char *)malloc(20000);
+    for (i = 0; len < 19000; i++) {
+        len += sprintf(buf + len, "%s", (i % 3 == 0) ? "/* some comment\n"
+                       "   with two lines \x80 and \x01 */" :
+                       (i % 3 == 1) ? "  \t\n      " : "ident");
+    }
+    buf[len++] = '*';   /* an unterminated comment at the end */
+    buf[len] = SENTINEL;
+
+    fast = zlex_open(dtrans, accept, nstates, NULL, 0);
+    lex = zlex_compile_flags(dtrans, accept, nstates, ZLEX_NO_ACCEL);
+    slow = zlex_cursor(lex, NULL, 0);
+    zlex_lexer_unref(lex);
+    for (i = 0; i < nstates; i++) {
+        if (fast->lex->accel[i].nbytes != 0) {
+            accelerated++;
+        }
+        if (slow->lex->accel[i].nbytes != 0) {
+            plain = false;
+        }
+    }
+
+    zlex_scan_buffer(fast, buf, len);
+    zlex_scan_buffer(slow, buf, len);
+    while (zlex_token(fast, &a)) {
+        if (!zlex_token(slow, &b) || a.rule != b.rule ||
+            a.offset != b.offset || a.len != b.len) {
+            same = false;
+            break;
+        }
+    }
+
+    check("states accelerated", accelerated >= 2 && plain);
+    check("accelerated tokens", same && !zlex_token(slow, &b));
+
+    zlex_close(fast);
+    zlex_close(slow);
+    free(buf);
+}
+
+/* rules of the same action accept the same string, strings of a pool of
+ * many chunks stay where they are */
+static void test_shared(void)
+{
+    ROW *dtrans;
+    accept_t *accept;
+    int nstates;
+    int plain;
+    lexer_t *lex;
+    pike_t *pike;
+    pike_scratch_t *scratch;
+    glushkov_t *g;
+    char *spec[66];
+    char text[64][64];
+    bool ok = true;
+    int i;
+
+    line = shared_rules;
+    plain = min_dfa(get_expr, &dtrans, &accept);
+    free(dtrans);
+    free(accept);
+
+    line = shared_rules-1;
+    nstates = min_dfa(get_expr, &dtrans, &accept);
+    lex = zlex_compile(dtrans, accept, nstates);
+    for (i = 0; i < nstates; i++) {
+        if (accept[i].string != NULL &&
+            strcmp(accept[i].string, "return KW;") == 0) {
+            ok = ok && ACCEPT_RULE(accept[i].string) == 0 &&
+                 ACCEPT_LINE(accept[i].string) == 2;
+        }
+    }
+    check("shared actions", ok && nstates < plain &&
+          zlex_match(lex, "if", 2) == 0 && zlex_match(lex, "do", 2) == 0 &&
+          zlex_match(lex, "ab", 2) == 1);
+    zlex_lexer_unref(lex);
+    free(dtrans);
+    free(accept);
+
+    /* "a[b]" shares the rule number 0, but "ab" has the higher priority in
+     * the other engines as well */
+    line = shared_rules-1;
+    pike = pike_new(get_expr);
+    line = shared_rules-1;
+    g = glushkov_new(get_expr);
+    scratch = pike_scratch_new(pike);
+    check("priority of shared actions",
+          pike_match(pike, scratch, "ab", 2) == 1 &&
+          glushkov_match(g, "ab", 2) == 1 &&
+          pike_match(pike, scratch, "do", 2) == 0);
+    pike_scratch_del(scratch);
+    pike_del(pike);
+    glushkov_del(g);
+
+    /* 64 rules of long actions, far more than a chunk */
+    spec[0] = "%option shared-actions";
+    for (i = 0; i < 64; i++) {
+        sprintf(text[i], "x%d %0*d", i, 48, i);
+        spec[i+1] = text[i];
+    }
+    spec[65] = NULL;
+    for (i = 0; i < 200; i++) {
+        line = spec-1;
+        nstates = dfa(get_expr, &dtrans, &accept);
+        if (i < 199) {
+            free(dtrans);
+            free(accept);
+        }
+    }
+    for (i = 0; i < nstates; i++) {
+        if (accept[i].string != NULL) {
+            ok = ok && strlen(accept[i].string) == 48 &&
+                 atoi(accept[i].string) == accept[i].rule &&
+                 ACCEPT_LINE(accept[i].string) == accept[i].rule + 2;
+        }
+    }
+    check("growing string pool", ok);
+    free(dtrans);
+    free(accept);
+}
+
+int main(int argc, char *argv[])
+{
+    ROW *dtrans;
+    accept_t *accept;
+    int nstates;
+    int i;
+
+    nstates = dfa(get_expr, &dtrans, &accept);
+    for (i = 0; i < nstates; i++) {
+        if (accept[i].string != NULL &&
+            ACCEPT_LINE(accept[i].string) != accept[i].rule + 1) {
+            break;
+        }
+    }
+    check("line numbers of the rules", i == nstates);
+
+    test_stream(dtrans, accept, nstates);
+    test_buffer(dtrans, accept, nstates);
+    test_batch(dtrans, accept, nstates);
+    test_push(dtrans, accept, nstates);
+    test_streams(dtrans, accept, nstates);
+    test_threads(dtrans, accept, nstates);
+    test_accel();
+    test_conds();
+    test_anchors();
+    test_trail();
+    test_repeat();
+    test_caseless();
+    test_trie();
+    test_compact();
+    test_shared();
+
+    return Errors ? 1 : 0;
+}
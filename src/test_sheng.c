@@ -0,0 +1,95 @@
+/* test_sheng.c
+ * Test the minimization of DFAs and the shuffle based engine: the minimal
+ * DFA run by PSHUFB, by the scalar masks and by zlex_match() should accept
+ * the same strings as the original DFA. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dfa.h"
+#include "scan.h"
+#include "sheng.h"
+#include "check.h"
+
+char *rules[] = {
+    "[0-9]+ INT",
+    "[0-9]+\\.[0-9]+ FLOAT",
+    "(if|of) KW",
+    "[a-z]+ WORD",
+    NULL,
+};
+
+char **line;
+
+char *get_expr(void)
+{
+    line++;
+    return *line;
+}
+
+/* walk the original table */
+static int full_match(ROW *dtrans, accept_t *accept, const char *buf, int len)
+{
+    int state = 0;
+    int i;
+
+    for (i = 0; i < len; i++) {
+        if ((unsigned char)buf[i] >= MAX_CHARS ||
+            (state = dtrans[state][(unsigned char)buf[i]]) == F) {
+            return F;
+        }
+    }
+    return accept[state].string ? accept[state].rule : F;
+}
+
+typedef struct engines
+{
+    ROW *dtrans;
+    accept_t *accept;
+    sheng_t *sheng;
+    lexer_t *lex;
+} engines_t;
+
+/* PSHUFB, the scalar masks and zlex_match() against the original DFA */
+static bool agree(char *buf, int len, void *arg)
+{
+    engines_t *e = (engines_t *)arg;
+    int want = full_match(e->dtrans, e->accept, buf, len);
+
+    return sheng_match(e->sheng, buf, len) == want &&
+           sheng_match_scalar(e->sheng, buf, len) == want &&
+           zlex_match(e->lex, buf, len) == want;
+}
+
+int main(int argc, char *argv[])
+{
+    ROW *dtrans, *min_trans;
+    accept_t *accept, *min_accept;
+    int nstates, min_states;
+    lexer_t *lex;
+    sheng_t *sheng;
+    engines_t e;
+
+    line = rules-1;
+    nstates = dfa(get_expr, &dtrans, &accept);
+    line = rules-1;
+    min_states = min_dfa(get_expr, &min_trans, &min_accept);
+
+    check("minimized", min_states < nstates);
+
+    sheng = sheng_new(min_trans, min_accept, min_states);
+    lex = zlex_compile(min_trans, min_accept, min_states);
+    check("sheng selected", sheng != NULL && lex->sheng != NULL);
+    if (sheng == NULL) {
+        return 1;
+    }
+
+    e.dtrans = dtrans;
+    e.accept = accept;
+    e.sheng = sheng;
+    e.lex = lex;
+    random_strings("random strings", "09.ifoz\x80", 16, 10000, 33, agree, &e);
+
+    sheng_del(sheng);
+    zlex_lexer_unref(lex);
+    return Errors ? 1 : 0;
+}
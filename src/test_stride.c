@@ -0,0 +1,86 @@
+/* test_stride.c
+ * Test scanning with the pair table: the tokens should be the same as the
+ * ones scanned a byte at a time, including lexemes that are accepted in the
+ * middle of a pair. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "dfa.h"
+#include "scan.h"
+#include "stride.h"
+#include "check.h"
+
+char *rules[] = {
+    "a A",
+    "abc ABC",
+    "[0-9]+ NUM",
+    "[0-9]+x[0-9]+ HEX",
+    "[\\s\\n]+",
+    NULL,
+};
+
+char **line = rules-1;
+
+char *get_expr(void)
+{
+    line++;
+    return *line;
+}
+
+/* the tokens of both scanners, *arg*, should be the same, now and then with
+ * a NUL in the data */
+static bool same_tokens(char *buf, int len, void *arg)
+{
+    scanner_t *a = ((scanner_t **)arg)[0];
+    scanner_t *b = ((scanner_t **)arg)[1];
+    token_t ta, tb;
+
+    if (len > 0 && rand() % 10 == 0) {
+        buf[rand() % len] = '\0';
+    }
+
+    zlex_scan_buffer(a, buf, len);
+    zlex_scan_buffer(b, buf, len);
+    while (zlex_token(a, &ta)) {
+        if (!zlex_token(b, &tb) || ta.rule != tb.rule ||
+            ta.offset != tb.offset || ta.len != tb.len) {
+            return false;
+        }
+    }
+    return !zlex_token(b, &tb);
+}
+
+int main(int argc, char *argv[])
+{
+    ROW *dtrans;
+    accept_t *accept;
+    int nstates;
+    scanner_t *fast;
+    scanner_t *slow;
+    scanner_t *both[2];
+    token_t token;
+
+    nstates = dfa(get_expr, &dtrans, &accept);
+    fast = zlex_open(dtrans, accept, nstates, NULL, 0);
+    slow = zlex_open(dtrans, accept, nstates, NULL, 0);
+    stride_del(slow->lex->stride);
+    slow->lex->stride = NULL;
+
+    check("pair table built", fast->lex->stride != NULL &&
+          fast->lex->stride->nclasses < 16);
+
+    /* "a" is accepted after the first byte of the pair "ab" */
+    zlex_scan_buffer(fast, "abx", 3);
+    check("accept in the middle of a pair", zlex_token(fast, &token) &&
+          token.rule == 0 && token.len == 1);
+
+    both[0] = fast;
+    both[1] = slow;
+    random_strings("random buffers", "abcx09 \n", 63, 10000, 34,
+                   same_tokens, both);
+
+    zlex_close(fast);
+    zlex_close(slow);
+    return Errors ? 1 : 0;
+}